@@ -0,0 +1,263 @@
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_INTERNAL
+#include "arena.h"
+#include "game_rules.h"
+
+#define ARENA_BODY_CAPACITY 16
+
+typedef struct {
+	int width;
+	int xy[2];
+	void (*func)(void *arg, void *context);
+	void *context;
+} ArenaForeach_callback;
+
+void internal_arena_moving_set(Arena *a, int snake, int moving)
+{
+	if (moving && a->moving_slot[snake] < 0) {
+		a->moving_slot[snake] = a->moving_count;
+		a->moving[a->moving_count++] = snake;
+	} else if (!moving && a->moving_slot[snake] >= 0) {
+		int last = a->moving[--a->moving_count];
+		a->moving[a->moving_slot[snake]] = last;
+		a->moving_slot[last] = a->moving_slot[snake];
+		a->moving_slot[snake] = -1;
+	}
+}
+
+/* Covers a free or food cell with the head of a snake. */
+void internal_arena_push(Arena *a, int snake, int cell)
+{
+	if (a->grid[cell] == -1) {
+		a->food_count--;
+	} else {
+		internal_free_remove(a->free_cells, a->free_index, &a->free_count, cell);
+	}
+	a->grid[cell] = snake + 1;
+
+	if (collections_queue_size(a->bodies[snake]) == a->body_capacity[snake]) {
+		a->bodies[snake] = collections_queue_grow(a->bodies[snake]);
+		a->body_capacity[snake] *= 2;
+	}
+	collections_queue_add(a->bodies[snake], &cell);
+	a->snake_x[snake] = cell % a->width;
+	a->snake_y[snake] = cell / a->width;
+}
+
+void internal_arena_pop(Arena *a, int snake)
+{
+	int cell;
+	collections_queue_peek_first(a->bodies[snake], &cell);
+	collections_queue_pop_first(a->bodies[snake]);
+	a->grid[cell] = 0;
+	internal_free_add(a->free_cells, a->free_index, &a->free_count, cell);
+}
+
+/* Takes a snake off the map and queues it to respawn. */
+void internal_arena_remove(Arena *a, int snake)
+{
+	while (collections_queue_size(a->bodies[snake]) > 0) {
+		internal_arena_pop(a, snake);
+	}
+	a->move_x[snake] = 0;
+	a->move_y[snake] = 0;
+	a->snake_length[snake] = 2;
+	a->snake_x[snake] = -1;
+	a->snake_y[snake] = -1;
+	internal_arena_moving_set(a, snake, 0);
+	a->waiting[a->waiting_count++] = snake;
+}
+
+/* Spawns the waiting snakes, oldest first, as long as there are free cells. The others wait for a later tick. */
+void internal_arena_spawn(Arena *a)
+{
+	int spawned = 0;
+	while (spawned < a->waiting_count && a->free_count > 0) {
+		internal_arena_push(a, a->waiting[spawned++], a->free_cells[random_bounded(&a->random, a->free_count)]);
+	}
+	a->waiting_count -= spawned;
+	memmove(a->waiting, a->waiting + spawned, a->waiting_count * sizeof(*a->waiting));
+}
+
+void internal_arena_food(Arena *a)
+{
+	while (a->food_count < a->food_target && a->free_count > 0) {
+		int cell = a->free_cells[random_bounded(&a->random, a->free_count)];
+		internal_free_remove(a->free_cells, a->free_index, &a->free_count, cell);
+		a->grid[cell] = -1;
+		a->food_count++;
+	}
+}
+
+Arena *arena_create(int width, int height, int snakes, int food, uint64_t seed)
+{
+	Arena *a = calloc(1, sizeof(*a));
+	a->width = width;
+	a->height = height;
+	a->cells = width * height;
+	a->snake_count = snakes;
+	a->food_target = food;
+	random_seed(&a->random, seed);
+
+	a->grid          = calloc(a->cells, sizeof(*a->grid));
+	a->claim_tick    = calloc(a->cells, sizeof(*a->claim_tick));
+	a->claim_snake   = calloc(a->cells, sizeof(*a->claim_snake));
+	a->free_cells    = malloc(a->cells * sizeof(*a->free_cells));
+	a->free_index    = malloc(a->cells * sizeof(*a->free_index));
+	a->snake_x       = calloc(snakes, sizeof(*a->snake_x));
+	a->snake_y       = calloc(snakes, sizeof(*a->snake_y));
+	a->move_x        = calloc(snakes, sizeof(*a->move_x));
+	a->move_y        = calloc(snakes, sizeof(*a->move_y));
+	a->snake_length  = calloc(snakes, sizeof(*a->snake_length));
+	a->body_capacity = calloc(snakes, sizeof(*a->body_capacity));
+	a->bodies        = calloc(snakes, sizeof(*a->bodies));
+	a->moving        = calloc(snakes, sizeof(*a->moving));
+	a->moving_slot   = calloc(snakes, sizeof(*a->moving_slot));
+	a->target        = calloc(snakes, sizeof(*a->target));
+	a->dead          = calloc(snakes, sizeof(*a->dead));
+	a->waiting       = calloc(snakes, sizeof(*a->waiting));
+
+	a->free_count = a->cells;
+	for (int c = 0; c < a->cells; ++c) {
+		a->free_cells[c] = c;
+		a->free_index[c] = c;
+	}
+
+	for (int i = 0; i < snakes; ++i) {
+		a->moving_slot[i] = -1;
+		a->body_capacity[i] = ARENA_BODY_CAPACITY;
+		a->bodies[i] = collections_queue_create(ARENA_BODY_CAPACITY, sizeof(int));
+		internal_arena_remove(a, i);
+	}
+	internal_arena_spawn(a);
+	internal_arena_food(a);
+
+	return a;
+}
+
+int arena_set_direction(Arena *a, int snake, GameSnakeDirection direction)
+{
+	if (collections_queue_size(a->bodies[snake]) == 0) return 0;
+	if (!internal_direction_apply(&a->move_x[snake], &a->move_y[snake], direction)) return 0;
+
+	internal_arena_moving_set(a, snake, 1);
+	return 1;
+}
+
+int arena_update(Arena *a, int *died)
+{
+	int deaths = 0;
+	a->tick++;
+
+	/* Every check sees the map as it was before the tick. */
+	for (int m = 0; m < a->moving_count; ++m) {
+		int i = a->moving[m];
+		int x = a->snake_x[i] + a->move_x[i];
+		int y = a->snake_y[i] + a->move_y[i];
+		a->dead[i] = 0;
+		a->target[i] = -1;
+
+		if (x < 0 || x >= a->width || y < 0 || y >= a->height) {
+			a->dead[i] = 1;
+			continue;
+		}
+
+		int cell = y * a->width + x;
+		a->target[i] = cell;
+		if (a->grid[cell] > 0) {
+			a->dead[i] = 1;
+		}
+
+		if (a->claim_tick[cell] == a->tick) {
+			a->dead[i] = 1;
+			a->dead[a->claim_snake[cell]] = 1;
+		} else {
+			a->claim_tick[cell] = a->tick;
+			a->claim_snake[cell] = i;
+		}
+	}
+
+	for (int m = 0; m < a->moving_count; ++m) {
+		int i = a->moving[m];
+		if (a->dead[i]) {
+			died[deaths++] = i;
+			continue;
+		}
+
+		if (a->grid[a->target[i]] == -1) {
+			a->snake_length[i]++;
+		}
+		if (collections_queue_size(a->bodies[i]) >= a->snake_length[i]) {
+			internal_arena_pop(a, i);
+		}
+		internal_arena_push(a, i, a->target[i]);
+	}
+
+	/* Every dead body leaves the map before anyone respawns, so the room it frees counts. */
+	for (int d = 0; d < deaths; ++d) {
+		internal_arena_remove(a, died[d]);
+	}
+	internal_arena_spawn(a);
+	internal_arena_food(a);
+
+	return deaths;
+}
+
+void arena_snake_get(Arena *a, int snake, int *position)
+{
+	position[0] = a->snake_x[snake];
+	position[1] = a->snake_y[snake];
+}
+
+int arena_snake_length(Arena *a, int snake)
+{
+	return a->snake_length[snake];
+}
+
+void internal_arena_foreach(void *arg, void *context)
+{
+	ArenaForeach_callback *instance = context;
+	int cell = *(int *)arg;
+	instance->xy[0] = cell % instance->width;
+	instance->xy[1] = cell / instance->width;
+	instance->func(instance->xy, instance->context);
+}
+
+void arena_snake_foreach(Arena *a, int snake, void func(void *arg, void *context), void *context)
+{
+	ArenaForeach_callback instance = { a->width, { 0, 0 }, func, context };
+	collections_queue_callback_context_set(a->bodies[snake], &instance);
+	collections_queue_foreach(a->bodies[snake], internal_arena_foreach);
+}
+
+int arena_cell(Arena *a, int x, int y)
+{
+	return a->grid[y * a->width + x];
+}
+
+void arena_destroy(Arena *a)
+{
+	for (int i = 0; i < a->snake_count; ++i) {
+		collections_queue_destroy(a->bodies[i]);
+	}
+	free(a->grid);
+	free(a->claim_tick);
+	free(a->claim_snake);
+	free(a->free_cells);
+	free(a->free_index);
+	free(a->snake_x);
+	free(a->snake_y);
+	free(a->move_x);
+	free(a->move_y);
+	free(a->snake_length);
+	free(a->body_capacity);
+	free(a->bodies);
+	free(a->moving);
+	free(a->moving_slot);
+	free(a->target);
+	free(a->dead);
+	free(a->waiting);
+	free(a);
+}
@@ -0,0 +1,226 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define AUTOPILOT_INTERNAL
+#include "autopilot.h"
+
+#define AUTOPILOT_NEVER INT_MAX
+
+/* Moves in GameSnakeDirection order, starting at GSD_DOWN. */
+const int AUTOPILOT_MOVE_X[4] = { 0, 0, 1, -1 };
+const int AUTOPILOT_MOVE_Y[4] = { -1, 1, 0, 0 };
+
+typedef struct {
+	Autopilot *autopilot;
+	int count;
+} AutopilotBody_callback;
+
+double internal_autopilot_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Collects the body cells, tail first, in the trail. */
+void internal_autopilot_body(void *xy, void *context)
+{
+	AutopilotBody_callback *instance = context;
+	Autopilot *autopilot = instance->autopilot;
+	autopilot->trail[instance->count++] = ((int *)xy)[1] * autopilot->width + ((int *)xy)[0];
+}
+
+/*
+ * Breadth first search from the head over time indexed occupancy: a cell is entered
+ * only if the tail has left it by the move that reaches it. Returns the cell the search
+ * stopped on, the food or -1.
+ */
+int internal_autopilot_search(Autopilot *autopilot, int head, int food, int back)
+{
+	autopilot->search++;
+	int front = 0, rear = 0;
+	autopilot->queue[rear++] = head;
+	autopilot->seen[head] = autopilot->search;
+	autopilot->distance[head] = 0;
+
+	while (front < rear) {
+		int cell = autopilot->queue[front++];
+		int x = cell % autopilot->width, y = cell / autopilot->width;
+		int moves = autopilot->distance[cell] + 1;
+		for (int m = 0; m < 4; ++m) {
+			if (cell == head && m == back) continue;
+			int nx = x + AUTOPILOT_MOVE_X[m], ny = y + AUTOPILOT_MOVE_Y[m];
+			if (nx < 0 || ny < 0 || nx >= autopilot->width || ny >= autopilot->height) continue;
+			int next = ny * autopilot->width + nx;
+			if (autopilot->seen[next] == autopilot->search || autopilot->free_at[next] > moves) continue;
+			autopilot->seen[next] = autopilot->search;
+			autopilot->distance[next] = moves;
+			autopilot->parent[next] = m;
+			if (next == food) return next;
+			autopilot->queue[rear++] = next;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Returns 1 if the snake of 'size' cells at the end of the trail, its head on the last cell,
+ * can still reach its tail through cells that are neither walls nor part of it.
+ */
+int internal_autopilot_tail_reachable(Autopilot *autopilot, const int *snake, int size)
+{
+	uint32_t search = ++autopilot->search;
+	for (int i = 0; i < size; ++i) {
+		autopilot->taken[snake[i]] = search;
+	}
+
+	int tail = snake[0], head = snake[size - 1];
+	int front = 0, rear = 0;
+	autopilot->queue[rear++] = head;
+	autopilot->seen[head] = search;
+	while (front < rear) {
+		int cell = autopilot->queue[front++];
+		int x = cell % autopilot->width, y = cell / autopilot->width;
+		for (int m = 0; m < 4; ++m) {
+			int nx = x + AUTOPILOT_MOVE_X[m], ny = y + AUTOPILOT_MOVE_Y[m];
+			if (nx < 0 || ny < 0 || nx >= autopilot->width || ny >= autopilot->height) continue;
+			int next = ny * autopilot->width + nx;
+			/* The head of a two cell snake cannot follow its tail by turning back on it. */
+			if (next == tail && (cell != head || size > 2)) return 1;
+			if (autopilot->seen[next] == search || autopilot->taken[next] == search || autopilot->free_at[next] == AUTOPILOT_NEVER) continue;
+			autopilot->seen[next] = search;
+			autopilot->queue[rear++] = next;
+		}
+	}
+	return 0;
+}
+
+Autopilot *autopilot_create(int width, int height)
+{
+	int cells = width * height;
+	Autopilot *autopilot = calloc(1, sizeof(*autopilot));
+	autopilot->width = width;
+	autopilot->height = height;
+	autopilot->free_at = malloc(cells * sizeof(*autopilot->free_at));
+	autopilot->seen = calloc(cells, sizeof(*autopilot->seen));
+	autopilot->distance = malloc(cells * sizeof(*autopilot->distance));
+	autopilot->parent = malloc(cells * sizeof(*autopilot->parent));
+	autopilot->queue = malloc(cells * sizeof(*autopilot->queue));
+	autopilot->taken = calloc(cells, sizeof(*autopilot->taken));
+	autopilot->trail = malloc(2 * cells * sizeof(*autopilot->trail));
+	return autopilot;
+}
+
+GameSnakeDirection autopilot_steer(Autopilot *autopilot, GameContext *game)
+{
+	double start = internal_autopilot_now();
+	int width = autopilot->width, height = autopilot->height;
+	int head_xy[2], food_xy[2], move[2];
+	game_get_head(game, head_xy);
+	game_get_food(game, food_xy);
+	game_get_move(game, move);
+
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			autopilot->free_at[y * width + x] = game_is_blocked(game, x, y) ? AUTOPILOT_NEVER : 0;
+		}
+	}
+	/*
+	 * The tail starts to follow once the snake has grown to its length. The head enters a cell
+	 * before the tail leaves, so a segment is out of the way from the move after its pop.
+	 */
+	AutopilotBody_callback body = { autopilot, 0 };
+	game_body_foreach(game, internal_autopilot_body, &body);
+	int growth = game_snake_length(game) - body.count;
+	if (growth < 0) growth = 0;
+	for (int i = 0; i < body.count; ++i) {
+		autopilot->free_at[autopilot->trail[i]] = growth + i + 2;
+	}
+
+	/* The snake cannot turn back on itself. */
+	int back = -1;
+	for (int m = 0; m < 4; ++m) {
+		if ((move[0] || move[1]) && AUTOPILOT_MOVE_X[m] == -move[0] && AUTOPILOT_MOVE_Y[m] == -move[1]) back = m;
+	}
+
+	int head = head_xy[1] * width + head_xy[0];
+	int food = food_xy[0] < 0 ? -1 : food_xy[1] * width + food_xy[0];
+	int choice = -1;
+	int cell = food >= 0 ? internal_autopilot_search(autopilot, head, food, back) : -1;
+	if (cell >= 0) {
+		/* Follows the path on the trail and checks that the snake eating the food can still reach its tail. */
+		int steps = autopilot->distance[cell];
+		for (int i = body.count + steps - 1; i >= body.count; --i) {
+			autopilot->trail[i] = cell;
+			int m = autopilot->parent[cell];
+			cell -= AUTOPILOT_MOVE_Y[m] * width + AUTOPILOT_MOVE_X[m];
+		}
+		int length = game_snake_length(game);
+		int size = (body.count + steps - 1 < length ? body.count + steps - 1 : length) + 1;
+		if (internal_autopilot_tail_reachable(autopilot, autopilot->trail + body.count + steps - size, size)) {
+			choice = autopilot->parent[autopilot->trail[body.count]];
+			autopilot->plans++;
+			autopilot->plan_steps += steps;
+		}
+	}
+
+	if (choice < 0) {
+		/*
+		 * No safe path: stall with a step after which the tail stays reachable, as far from it as
+		 * possible so it has time to clear the way, and without one take the step with the most room.
+		 */
+		int best = INT_MIN;
+		int length = game_snake_length(game);
+		int size = body.count < length ? body.count + 1 : length;
+		for (int m = 0; m < 4; ++m) {
+			int nx = head_xy[0] + AUTOPILOT_MOVE_X[m], ny = head_xy[1] + AUTOPILOT_MOVE_Y[m];
+			if (m == back || nx < 0 || ny < 0 || nx >= width || ny >= height || autopilot->free_at[ny * width + nx] > 1) continue;
+			autopilot->trail[body.count] = ny * width + nx;
+			int score;
+			if (internal_autopilot_tail_reachable(autopilot, autopilot->trail + body.count + 1 - size, size)) {
+				int tail = autopilot->trail[body.count + 1 - size];
+				score = width * height + abs(nx - tail % width) + abs(ny - tail / width);
+			} else {
+				score = game_reachable(game, nx, ny, NULL) - width * height;
+			}
+			if (score > best) {
+				best = score;
+				choice = m;
+			}
+		}
+		autopilot->fallbacks++;
+	}
+
+	GameSnakeDirection direction = GSD_NONE;
+	if (choice >= 0 && (AUTOPILOT_MOVE_X[choice] != move[0] || AUTOPILOT_MOVE_Y[choice] != move[1])) {
+		if (game_set_snake_direction(game, (GameSnakeDirection)(GSD_DOWN + choice))) {
+			direction = GSD_DOWN + choice;
+		}
+	}
+
+	autopilot->decisions++;
+	autopilot->seconds += internal_autopilot_now() - start;
+	return direction;
+}
+
+void autopilot_stats(Autopilot *autopilot, AutopilotStats *stats)
+{
+	stats->decisions = autopilot->decisions;
+	stats->plans = autopilot->plans;
+	stats->fallbacks = autopilot->fallbacks;
+	stats->decisions_per_second = autopilot->seconds > 0 ? autopilot->decisions / autopilot->seconds : 0;
+	stats->average_plan = autopilot->plans ? (double)autopilot->plan_steps / autopilot->plans : 0;
+}
+
+void autopilot_destroy(Autopilot *autopilot)
+{
+	free(autopilot->free_at);
+	free(autopilot->seen);
+	free(autopilot->distance);
+	free(autopilot->parent);
+	free(autopilot->queue);
+	free(autopilot->taken);
+	free(autopilot->trail);
+	free(autopilot);
+}
@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BATCH_INTERNAL
+#include "batch.h"
+#include "batch_kernel.h"
+#include "observe.h"
+
+_Static_assert(sizeof(GameSnakeDirection) == sizeof(int), "Actions are loaded as 32 bit lanes");
+
+void internal_batch_start(GameBatch *b, int i)
+{
+	internal_kernel_start(b, i, b->width, b->height);
+}
+
+void internal_batch_step_scalar(GameBatch *b, const GameSnakeDirection *actions, float *rewards, unsigned char *dones)
+{
+	internal_kernel_step_scalar(b, actions, rewards, dones, b->width, b->height);
+}
+
+#ifdef BATCH_X86
+__attribute__((target("avx2")))
+void internal_batch_step_avx2(GameBatch *b, const GameSnakeDirection *actions, float *rewards, unsigned char *dones)
+{
+	internal_kernel_step_avx2(b, actions, rewards, dones, b->width, b->height);
+}
+#endif
+
+/* Board sizes with their own kernels. */
+BATCH_KERNEL_SPECIALIZE(8, 8)
+BATCH_KERNEL_SPECIALIZE(10, 10)
+BATCH_KERNEL_SPECIALIZE(15, 15)
+BATCH_KERNEL_SPECIALIZE(16, 16)
+BATCH_KERNEL_SPECIALIZE(32, 32)
+
+static const struct {
+	int width, height;
+	GameBatchStep scalar;
+	GameBatchStep avx2; /* NULL off x86 */
+} BATCH_KERNELS[] = {
+	BATCH_KERNEL_ENTRY(8, 8),
+	BATCH_KERNEL_ENTRY(10, 10),
+	BATCH_KERNEL_ENTRY(15, 15),
+	BATCH_KERNEL_ENTRY(16, 16),
+	BATCH_KERNEL_ENTRY(32, 32),
+};
+
+/* Returns the index of the kernels specialized for the size of 'batch', or -1. */
+int internal_batch_specialized(GameBatch *batch)
+{
+	for (size_t k = 0; k < sizeof(BATCH_KERNELS) / sizeof(*BATCH_KERNELS); ++k) {
+		if (BATCH_KERNELS[k].width == batch->width && BATCH_KERNELS[k].height == batch->height) {
+			return k;
+		}
+	}
+	return -1;
+}
+
+GameBatch *game_batch_create(int count, int width, int height, uint64_t seed)
+{
+	GameBatch *b = calloc(1, sizeof(*b));
+	b->count = count;
+	b->width = width;
+	b->height = height;
+	b->cells = width * height;
+	b->row_words = (width + 63) / 64;
+	b->ring_bytes = (b->cells + 3) / 4;
+	b->start_x = width / 2;
+	b->start_y = height / 2;
+
+	b->snake_x      = malloc(count * sizeof(*b->snake_x));
+	b->snake_y      = malloc(count * sizeof(*b->snake_y));
+	b->move_x       = malloc(count * sizeof(*b->move_x));
+	b->move_y       = malloc(count * sizeof(*b->move_y));
+	b->food         = malloc(count * sizeof(*b->food));
+	b->snake_length = malloc(count * sizeof(*b->snake_length));
+	b->tail_x       = malloc(count * sizeof(*b->tail_x));
+	b->tail_y       = malloc(count * sizeof(*b->tail_y));
+	b->body_front   = malloc(count * sizeof(*b->body_front));
+	b->body_size    = malloc(count * sizeof(*b->body_size));
+	b->free_count   = malloc(count * sizeof(*b->free_count));
+	b->random       = malloc(count * sizeof(*b->random));
+	b->start_step   = malloc(count * sizeof(*b->start_step));
+	b->pushes       = malloc(count * sizeof(*b->pushes));
+	b->body         = malloc((size_t)count * b->ring_bytes);
+	b->free_cells   = malloc((size_t)count * b->cells * sizeof(*b->free_cells));
+	b->free_index   = malloc((size_t)count * b->cells * sizeof(*b->free_index));
+	b->occupancy    = malloc((size_t)count * height * b->row_words * sizeof(*b->occupancy));
+
+	for (int i = 0; i < count; ++i) {
+		random_seed(&b->random[i], seed + i);
+		internal_batch_start(b, i);
+	}
+
+	game_batch_kernel_set(b, GBK_AUTO);
+	return b;
+}
+
+int game_batch_count(GameBatch *batch)
+{
+	return batch->count;
+}
+
+void game_batch_step(GameBatch *batch, const GameSnakeDirection *actions, float *rewards, unsigned char *dones)
+{
+	batch->steps++;
+	batch->step(batch, actions, rewards, dones);
+}
+
+void game_batch_reset(GameBatch *batch)
+{
+	batch->steps++;
+	for (int i = 0; i < batch->count; ++i) {
+		internal_batch_start(batch, i);
+	}
+}
+
+typedef struct {
+	GameBatch *batch;
+	int game;
+} BatchObserve_source;
+
+void internal_batch_observe_body(void *source, void func(void *xy, void *context), void *context)
+{
+	GameBatch *b = ((BatchObserve_source *)source)->batch;
+	int i = ((BatchObserve_source *)source)->game;
+	const uint8_t *ring = &b->body[(size_t)i * b->ring_bytes];
+	int xy[] = { b->tail_x[i], b->tail_y[i] };
+	for (int s = 0; s < b->body_size[i]; ++s) {
+		func(xy, context);
+		if (s + 1 < b->body_size[i]) {
+			int slot = (b->body_front[i] + s) % b->cells;
+			unsigned code = (ring[slot >> 2] >> ((slot & 3) * 2)) & 3;
+			xy[0] += BODY_CODE_X[code];
+			xy[1] += BODY_CODE_Y[code];
+		}
+	}
+}
+
+void game_batch_observe(GameBatch *batch, GameObserveLayout *layouts, void *dst)
+{
+	size_t size = observe_size(batch->width, batch->height, &layouts[0]);
+	for (int i = 0; i < batch->count; ++i) {
+		BatchObserve_source source = { batch, i };
+		ObserveFrame frame = {
+			batch->width, batch->height,
+			batch->snake_y[i] * batch->width + batch->snake_x[i],
+			batch->food[i], batch->body_size[i] ? batch->tail_y[i] * batch->width + batch->tail_x[i] : -1,
+			batch->body_size[i], batch->pushes[i], batch->steps, batch->start_step[i], NULL,
+			internal_batch_observe_body, &source,
+		};
+		observe_write(&frame, &layouts[i], (char *)dst + i * size);
+	}
+}
+
+int game_batch_kernel_set(GameBatch *batch, GameBatchKernel kernel)
+{
+	int specialized = internal_batch_specialized(batch);
+	switch (kernel) {
+		case GBK_AUTO:
+			if (game_batch_kernel_set(batch, GBK_AVX2_FIXED)) return 1;
+			if (game_batch_kernel_set(batch, GBK_AVX2)) return 1;
+			if (game_batch_kernel_set(batch, GBK_SCALAR_FIXED)) return 1;
+			return game_batch_kernel_set(batch, GBK_SCALAR);
+		case GBK_SCALAR:
+			batch->step = internal_batch_step_scalar;
+			return 1;
+		case GBK_SCALAR_FIXED:
+			if (specialized < 0) return 0;
+			batch->step = BATCH_KERNELS[specialized].scalar;
+			return 1;
+		case GBK_AVX2:
+		case GBK_AVX2_FIXED:
+#ifdef BATCH_X86
+			if (!__builtin_cpu_supports("avx2")) return 0;
+			/* Gather indices are 32 bit. */
+			if ((int64_t)batch->count * batch->height * batch->row_words * 2 > INT32_MAX) return 0;
+			if (kernel == GBK_AVX2) {
+				batch->step = internal_batch_step_avx2;
+				return 1;
+			}
+			if (specialized < 0) return 0;
+			batch->step = BATCH_KERNELS[specialized].avx2;
+			return 1;
+#else
+			return 0;
+#endif
+	}
+
+	return 0;
+}
+
+void game_batch_destroy(GameBatch *batch)
+{
+	free(batch->snake_x);
+	free(batch->snake_y);
+	free(batch->move_x);
+	free(batch->move_y);
+	free(batch->food);
+	free(batch->snake_length);
+	free(batch->tail_x);
+	free(batch->tail_y);
+	free(batch->body_front);
+	free(batch->body_size);
+	free(batch->free_count);
+	free(batch->random);
+	free(batch->start_step);
+	free(batch->pushes);
+	free(batch->body);
+	free(batch->free_cells);
+	free(batch->free_index);
+	free(batch->occupancy);
+	free(batch);
+}
@@ -0,0 +1,354 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "autopilot.h"
+#include "batch.h"
+#include "bitboard.h"
+#include "game.h"
+#include "random.h"
+#include "rollout.h"
+#include "scheduler.h"
+
+#define BENCH_WIDTH  15
+#define BENCH_HEIGHT 15
+#define BENCH_STEPS  (1 << 22) /* Game steps per measurement */
+#define BENCH_GAMES  16384     /* Games in the rollout measurement */
+#define BENCH_SHARD  256       /* Games per rollout shard */
+
+volatile int64_t bench_sink; /* Keeps results of measured work from being optimized away */
+
+double bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Fills 'actions' with a random turn for roughly one game in four.
+ */
+void bench_actions(Random *random, GameSnakeDirection *actions, int count)
+{
+	for (int i = 0; i < count; ++i) {
+		uint32_t r = random_next(random);
+		actions[i] = (r & 3) == 0 ? (GameSnakeDirection)(1 + ((r >> 2) & 3)) : GSD_NONE;
+	}
+}
+
+/*
+ * Returns steps per second of 'kernel' on a batch of 'count' games of 'size' x 'size', or 0 if the kernel is unsupported.
+ */
+double bench_batch(GameBatchKernel kernel, int count, int size)
+{
+	GameBatch *batch = game_batch_create(count, size, size, 1);
+	if (!game_batch_kernel_set(batch, kernel)) {
+		game_batch_destroy(batch);
+		return 0;
+	}
+
+	GameSnakeDirection *actions = malloc(count * sizeof(*actions));
+	float *rewards = malloc(count * sizeof(*rewards));
+	unsigned char *dones = malloc(count);
+	Random random;
+	random_seed(&random, 2);
+
+	int steps = BENCH_STEPS / count;
+	double start = bench_now();
+	for (int s = 0; s < steps; ++s) {
+		bench_actions(&random, actions, count);
+		game_batch_step(batch, actions, rewards, dones);
+	}
+	double elapsed = bench_now() - start;
+
+	free(actions);
+	free(rewards);
+	free(dones);
+	game_batch_destroy(batch);
+	return (double)steps * count / elapsed;
+}
+
+void bench_policy(void *context, int first, int count, Random *random, GameSnakeDirection *actions)
+{
+	(void)context;
+	(void)first;
+	bench_actions(random, actions, count);
+}
+
+/*
+ * Returns steps per second of a free running rollout on 'workers' threads.
+ */
+double bench_rollout(int workers)
+{
+	Scheduler *scheduler = scheduler_create(workers);
+	Rollout *rollout = rollout_create(scheduler, BENCH_GAMES, BENCH_WIDTH, BENCH_HEIGHT, BENCH_SHARD, 1);
+
+	double start = bench_now();
+	rollout_run(rollout, 4 * BENCH_STEPS / BENCH_GAMES, bench_policy, NULL);
+	double elapsed = bench_now() - start;
+
+	RolloutStats stats;
+	rollout_stats(rollout, &stats);
+	rollout_destroy(rollout);
+	scheduler_destroy(scheduler);
+	return stats.steps / elapsed;
+}
+
+/*
+ * Returns game updates per second of a single game on a 'size' x 'size' map created with 'flags'.
+ */
+double bench_world(int size, int flags)
+{
+	GameContext *game = game_create_ex(size, size, 1, flags);
+	game_start(game, size / 2, size / 2);
+	Random random;
+	random_seed(&random, 2);
+
+	double start = bench_now();
+	for (int s = 0; s < BENCH_STEPS; ++s) {
+		GameSnakeDirection direction;
+		bench_actions(&random, &direction, 1);
+		if (direction) game_set_snake_direction(game, direction);
+		if (game_update(game)) game_start(game, size / 2, size / 2);
+	}
+	double elapsed = bench_now() - start;
+
+	game_destroy(game);
+	return BENCH_STEPS / elapsed;
+}
+
+/*
+ * Returns episodes per second when every short episode gets a fresh game, created and destroyed
+ * or acquired from and released to a pool.
+ */
+double bench_churn(int size, int pooled)
+{
+	const int episodes = BENCH_STEPS / 64;
+	GamePool *pool = pooled ? game_pool_create(size, size, GAME_COMPACT_BODY, 0) : NULL;
+	Random random;
+	random_seed(&random, 3);
+
+	double start = bench_now();
+	for (int e = 0; e < episodes; ++e) {
+		GameContext *game = pooled ? game_pool_acquire(pool, e) : game_create_ex(size, size, e, GAME_COMPACT_BODY);
+		game_start(game, size / 2, size / 2);
+		for (int s = 0; s < 16; ++s) {
+			GameSnakeDirection direction;
+			bench_actions(&random, &direction, 1);
+			if (direction) game_set_snake_direction(game, direction);
+			if (game_update(game)) break;
+		}
+		game_destroy(game);
+	}
+	double elapsed = bench_now() - start;
+
+	if (pool) game_pool_destroy(pool);
+	return episodes / elapsed;
+}
+
+/*
+ * Returns ticks per second of a game on a 'size' x 'size' map that circles a square of side 'gap',
+ * stepped tick by tick or fast forwarded between turns.
+ */
+double bench_advance(int size, int gap, int fast)
+{
+	const GameSnakeDirection square[] = { GSD_UP, GSD_RIGHT, GSD_DOWN, GSD_LEFT };
+	GameContext *game = game_create_ex(size, size, 1, GAME_COMPACT_BODY);
+	game_start(game, (size - gap) / 2, (size - gap) / 2);
+
+	double start = bench_now();
+	for (int turn = 0; game_ticks(game) < BENCH_STEPS; ++turn) {
+		game_set_snake_direction(game, square[turn % 4]);
+		int lost = 0;
+		if (fast) {
+			lost = game_advance(game, gap);
+		} else {
+			for (int s = 0; s < gap && !lost; ++s) lost = game_update(game);
+		}
+		if (lost) game_start(game, (size - gap) / 2, (size - gap) / 2);
+	}
+	double elapsed = bench_now() - start;
+	double ticks = game_ticks(game);
+
+	game_destroy(game);
+	return ticks / elapsed;
+}
+
+/*
+ * Returns updates per second of a single 'size' x 'size' game on the GameContext or the bitboard core,
+ * with random turns. With 'fill' set, every update is followed by a flood fill from the head.
+ */
+double bench_core(int size, int bitboard, int fill)
+{
+	GameContext *game = bitboard ? NULL : game_create_ex(size, size, 1, GAME_COMPACT_BODY);
+	BitboardGame board;
+	if (bitboard) bitboard_init(&board, size, size, 1);
+	if (game) game_start(game, size / 2, size / 2); else bitboard_start(&board, size / 2, size / 2);
+	Random random;
+	random_seed(&random, 5);
+	int64_t cells = 0;
+
+	double start = bench_now();
+	for (int s = 0; s < BENCH_STEPS; ++s) {
+		GameSnakeDirection direction;
+		bench_actions(&random, &direction, 1);
+		if (game) {
+			if (direction) game_set_snake_direction(game, direction);
+			if (game_update(game)) game_start(game, size / 2, size / 2);
+			if (fill) {
+				int head[2];
+				game_get_head(game, head);
+				cells += game_reachable(game, head[0], head[1], NULL);
+			}
+		} else {
+			if (bitboard_update(&board, direction)) bitboard_start(&board, size / 2, size / 2);
+			if (fill) cells += bitboard_reachable(&board, board.head % BITBOARD_SIDE, board.head / BITBOARD_SIDE, NULL);
+		}
+	}
+	double elapsed = bench_now() - start;
+
+	if (game) game_destroy(game);
+	if (fill) bench_sink += cells;
+	return BENCH_STEPS / elapsed;
+}
+
+/*
+ * Plays 'size' x 'size' games with the autopilot and prints its decision rate, plan length and scores.
+ */
+void bench_autopilot(int size)
+{
+	Autopilot *autopilot = autopilot_create(size, size);
+	GameContext *game = game_create(size, size, 1);
+	game_start(game, size / 2, size / 2);
+	int episodes = 0, best = 0;
+	int64_t food = 0;
+
+	double start = bench_now();
+	for (int s = 0; s < BENCH_STEPS / 16; ++s) {
+		autopilot_steer(autopilot, game);
+		if (game_update(game)) {
+			int score = game_snake_length(game) - 2;
+			food += score;
+			if (score > best) best = score;
+			episodes++;
+			game_start(game, size / 2, size / 2);
+		}
+	}
+	double elapsed = bench_now() - start;
+
+	AutopilotStats stats;
+	autopilot_stats(autopilot, &stats);
+	printf("%8d %14.0f %14.0f %10.1f %10.1f %8d\n", size, stats.decisions_per_second, stats.decisions / elapsed,
+		stats.average_plan, episodes ? (double)food / episodes : 0.0, best);
+	game_destroy(game);
+	autopilot_destroy(autopilot);
+}
+
+/*
+ * Returns arena ticks per second with 'snakes' snakes of which 'moving' get directions.
+ */
+double bench_arena(int snakes, int moving)
+{
+	Arena *arena = arena_create(512, 512, snakes, snakes / 4 + 1, 1);
+	int *died = malloc(snakes * sizeof(*died));
+	Random random;
+	random_seed(&random, 2);
+
+	int ticks = BENCH_STEPS / 256;
+	double start = bench_now();
+	for (int t = 0; t < ticks; ++t) {
+		for (int i = 0; i < moving; ++i) {
+			GameSnakeDirection direction;
+			bench_actions(&random, &direction, 1);
+			arena_set_direction(arena, i, direction ? direction : GSD_UP);
+		}
+		arena_update(arena, died);
+	}
+	double elapsed = bench_now() - start;
+
+	free(died);
+	arena_destroy(arena);
+	return ticks / elapsed;
+}
+
+int main(void)
+{
+	const int lanes[] = { 8, 64, 512, 4096 };
+
+	printf("batch kernels, %dx%d board (steps/sec)\n", BENCH_WIDTH, BENCH_HEIGHT);
+	printf("%8s %14s %14s %8s\n", "games", "scalar", "avx2", "speedup");
+	for (unsigned i = 0; i < sizeof(lanes) / sizeof(*lanes); ++i) {
+		double scalar = bench_batch(GBK_SCALAR, lanes[i], BENCH_WIDTH);
+		double avx2 = bench_batch(GBK_AVX2, lanes[i], BENCH_WIDTH);
+		printf("%8d %14.0f %14.0f %7.2fx\n", lanes[i], scalar, avx2, avx2 / scalar);
+	}
+
+	const int fixed_sizes[] = { 15, 16, 32 };
+	printf("\ngeneric and fixed size kernels, %d games (steps/sec)\n", lanes[2]);
+	printf("%8s %14s %14s %14s %14s\n", "size", "scalar", "scalar fixed", "avx2", "avx2 fixed");
+	for (unsigned i = 0; i < sizeof(fixed_sizes) / sizeof(*fixed_sizes); ++i) {
+		printf("%8d %14.0f %14.0f %14.0f %14.0f\n", fixed_sizes[i],
+			bench_batch(GBK_SCALAR, lanes[2], fixed_sizes[i]), bench_batch(GBK_SCALAR_FIXED, lanes[2], fixed_sizes[i]),
+			bench_batch(GBK_AVX2, lanes[2], fixed_sizes[i]), bench_batch(GBK_AVX2_FIXED, lanes[2], fixed_sizes[i]));
+	}
+
+	const int sizes[] = { 16, 1024, 16384, 100000 };
+	printf("\nsingle game by map size (steps/sec)\n");
+	printf("%8s %14s %14s\n", "size", "dense", "chunked");
+	for (unsigned i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i) {
+		/* Dense maps past 1024x1024 take gigabytes. */
+		double dense = sizes[i] <= 1024 ? bench_world(sizes[i], GAME_COMPACT_BODY) : 0;
+		double chunked = bench_world(sizes[i], GAME_COMPACT_BODY | GAME_CHUNKED);
+		printf("%8d %14.0f %14.0f\n", sizes[i], dense, chunked);
+	}
+
+	printf("\nsingle game core, 15x15 board (updates/sec)\n");
+	printf("%14s %14s %14s %14s\n", "game", "game+fill", "bitboard", "bitboard+fill");
+	printf("%14.0f %14.0f %14.0f %14.0f\n", bench_core(15, 0, 0), bench_core(15, 0, 1), bench_core(15, 1, 0), bench_core(15, 1, 1));
+
+	printf("\nautopilot\n");
+	printf("%8s %14s %14s %10s %10s %8s\n", "size", "decisions/sec", "updates/sec", "avg plan", "avg score", "best");
+	const int autopilot_sizes[] = { 8, 15, 32 };
+	for (unsigned i = 0; i < sizeof(autopilot_sizes) / sizeof(*autopilot_sizes); ++i) {
+		bench_autopilot(autopilot_sizes[i]);
+	}
+
+	const int churn_sizes[] = { 15, 64, 256 };
+	printf("\ngame churn, 16 step episodes (episodes/sec)\n");
+	printf("%8s %14s %14s %8s\n", "size", "create", "pool", "speedup");
+	for (unsigned i = 0; i < sizeof(churn_sizes) / sizeof(*churn_sizes); ++i) {
+		double created = bench_churn(churn_sizes[i], 0);
+		double pooled = bench_churn(churn_sizes[i], 1);
+		printf("%8d %14.0f %14.0f %7.2fx\n", churn_sizes[i], created, pooled, pooled / created);
+	}
+
+	printf("\nfast forward between turns, 1024x1024 map (ticks/sec)\n");
+	printf("%8s %14s %14s %8s\n", "gap", "update", "advance", "speedup");
+	for (int gap = 4; gap <= 256; gap *= 4) {
+		double stepped = bench_advance(1024, gap, 0);
+		double fast = bench_advance(1024, gap, 1);
+		printf("%8d %14.0f %14.0f %7.2fx\n", gap, stepped, fast, fast / stepped);
+	}
+
+	printf("\narena, 512x512 map with 1024 snakes (ticks/sec)\n");
+	printf("%8s %14s\n", "moving", "ticks/sec");
+	for (int moving = 16; moving <= 1024; moving *= 8) {
+		printf("%8d %14.0f\n", moving, bench_arena(1024, moving));
+	}
+
+	int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	printf("\nrollout, %d games in shards of %d (steps/sec)\n", BENCH_GAMES, BENCH_SHARD);
+	printf("%8s %14s %8s\n", "workers", "steps/sec", "scaling");
+	double single = 0;
+	for (int workers = 1;; workers *= 2) {
+		if (workers > cores) workers = cores;
+		double rate = bench_rollout(workers);
+		if (workers == 1) single = rate;
+		printf("%8d %14.0f %7.2fx\n", workers, rate, rate / single);
+		if (workers == cores) break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitboard.h"
+#include "game_rules.h"
+
+/* Columns 0 and 15 of every row in a word. */
+#define BITBOARD_COLUMN_FIRST 0x0001000100010001ull
+#define BITBOARD_COLUMN_LAST  0x8000800080008000ull
+
+void internal_error_bitboard_size(int line, int width, int height)
+{
+	fprintf(stderr, "%d: Attempting to use a %dx%d board, bitboard games are at most %dx%d.\n", line, width, height, BITBOARD_SIDE, BITBOARD_SIDE);
+	exit(-1);
+}
+
+void internal_error_bitboard_position(int line, int x, int y)
+{
+	fprintf(stderr, "%d: Attempting to start the snake on a blocked cell (%d, %d).\n", line, x, y);
+	exit(-1);
+}
+
+void internal_error_bitboard_not_started(int line)
+{
+	fprintf(stderr, "%d: Attempting to update a bitboard game that is not started.\n", line);
+	exit(-1);
+}
+
+int internal_bitboard_test(const Bitboard *board, int cell)
+{
+	return (board->words[cell >> 6] >> (cell & 63)) & 1;
+}
+
+void internal_bitboard_set(Bitboard *board, int cell)
+{
+	board->words[cell >> 6] |= (uint64_t)1 << (cell & 63);
+}
+
+void internal_bitboard_clear(Bitboard *board, int cell)
+{
+	board->words[cell >> 6] &= ~((uint64_t)1 << (cell & 63));
+}
+
+/* Returns the cell of the 'rank'th set bit of 'board', counting from cell 0. */
+int internal_bitboard_select(const Bitboard *board, int rank)
+{
+	for (int w = 0; w < 4; ++w) {
+		uint64_t word = board->words[w];
+		int count = __builtin_popcountll(word);
+		if (rank < count) {
+			while (rank-- > 0) word &= word - 1;
+			return w * 64 + __builtin_ctzll(word);
+		}
+		rank -= count;
+	}
+	return -1;
+}
+
+/* Sets 'blocked' to every cell outside a 'width' x 'height' map. */
+void internal_bitboard_outside(BitboardGame *game, int width, int height)
+{
+	if (width < 1 || height < 1 || width > BITBOARD_SIDE || height > BITBOARD_SIDE) {
+		internal_error_bitboard_size(__LINE__, width, height);
+	}
+
+	memset(game, 0, sizeof(*game));
+	game->width = width;
+	game->height = height;
+	game->food = -1;
+	for (int cell = 0; cell < BITBOARD_SIDE * BITBOARD_SIDE; ++cell) {
+		if (cell % BITBOARD_SIDE >= width || cell / BITBOARD_SIDE >= height) {
+			internal_bitboard_set(&game->blocked, cell);
+		}
+	}
+}
+
+void bitboard_init(BitboardGame *game, int width, int height, uint64_t seed)
+{
+	internal_bitboard_outside(game, width, height);
+	random_seed(&game->random, seed);
+}
+
+void bitboard_init_level(BitboardGame *game, const Level *level, uint64_t seed)
+{
+	internal_bitboard_outside(game, level_width(level), level_height(level));
+	random_seed(&game->random, seed);
+
+	/* Rows of at most 16 cells take one occupancy word each. Masked so no bit spills into the next row. */
+	const uint64_t *walls = level_walls(level);
+	for (int y = 0; y < game->height; ++y) {
+		game->blocked.words[y >> 2] |= (walls[y] & 0xffff) << (16 * (y & 3));
+	}
+}
+
+void internal_bitboard_push(BitboardGame *game, int cell)
+{
+	game->ring[(uint8_t)(game->front + game->body_size)] = cell;
+	game->body_size++;
+	internal_bitboard_set(&game->body, cell);
+}
+
+void internal_bitboard_pop(BitboardGame *game)
+{
+	internal_bitboard_clear(&game->body, game->ring[game->front++]);
+	game->body_size--;
+}
+
+/* Places the food on a uniformly chosen free cell or off the map if there are none. */
+void internal_bitboard_respawn_food(BitboardGame *game)
+{
+	Bitboard free;
+	for (int w = 0; w < 4; ++w) {
+		free.words[w] = ~(game->body.words[w] | game->blocked.words[w]);
+	}
+	int count = bitboard_count(&free);
+	game->food = count ? internal_bitboard_select(&free, random_bounded(&game->random, count)) : -1;
+}
+
+void bitboard_start(BitboardGame *game, int snake_x, int snake_y)
+{
+	memset(&game->body, 0, sizeof(game->body));
+	game->body_size = 0;
+	game->front = 0;
+	if (bitboard_is_blocked(game, snake_x, snake_y)) internal_error_bitboard_position(__LINE__, snake_x, snake_y);
+
+	game->started = 1;
+	game->head = snake_y * BITBOARD_SIDE + snake_x;
+	game->move_x = 0;
+	game->move_y = 0;
+	game->snake_length = 2;
+	game->start_tick = game->ticks;
+	internal_bitboard_push(game, game->head);
+	internal_bitboard_respawn_food(game);
+}
+
+int bitboard_update(BitboardGame *game, GameSnakeDirection direction)
+{
+	if (!game->started) internal_error_bitboard_not_started(__LINE__);
+	game->ticks++;
+
+	internal_direction_apply(&game->move_x, &game->move_y, direction);
+
+	if (game->move_x + game->move_y == 0) return 0;
+
+	int new_x = game->head % BITBOARD_SIDE + game->move_x;
+	int new_y = game->head / BITBOARD_SIDE + game->move_y;
+	int cell = new_y * BITBOARD_SIDE + new_x;
+	if ((unsigned)new_x >= BITBOARD_SIDE || (unsigned)new_y >= BITBOARD_SIDE ||
+		((game->body.words[cell >> 6] | game->blocked.words[cell >> 6]) >> (cell & 63)) & 1) {
+		game->started = 0;
+		return 1;
+	}
+
+	int ate = cell == game->food;
+	if (ate) {
+		game->snake_length++;
+	}
+	if (game->body_size >= game->snake_length) {
+		internal_bitboard_pop(game);
+	}
+	internal_bitboard_push(game, cell);
+	game->head = cell;
+	if (ate) {
+		internal_bitboard_respawn_food(game);
+	}
+	return 0;
+}
+
+int bitboard_is_blocked(const BitboardGame *game, int x, int y)
+{
+	if (x < 0 || y < 0 || x >= game->width || y >= game->height) {
+		return 1;
+	}
+	int cell = y * BITBOARD_SIDE + x;
+	return internal_bitboard_test(&game->body, cell) || internal_bitboard_test(&game->blocked, cell);
+}
+
+/* Bits of 'r' moved one cell left and right, without those wrapping to another row. */
+uint64_t internal_bitboard_sides(uint64_t r)
+{
+	return (r << 1 & ~BITBOARD_COLUMN_FIRST) | (r >> 1 & ~BITBOARD_COLUMN_LAST);
+}
+
+/*
+ * Grows the region by one step in every direction at once, within the open cells, until it
+ * stops changing. Vertical steps shift by a row and carry the edge rows across words.
+ */
+int bitboard_reachable(const BitboardGame *game, int x, int y, Bitboard *region)
+{
+	uint64_t open0 = ~(game->body.words[0] | game->blocked.words[0]);
+	uint64_t open1 = ~(game->body.words[1] | game->blocked.words[1]);
+	uint64_t open2 = ~(game->body.words[2] | game->blocked.words[2]);
+	uint64_t open3 = ~(game->body.words[3] | game->blocked.words[3]);
+	Bitboard reached = { { 0 } };
+	if ((unsigned)x < BITBOARD_SIDE && (unsigned)y < BITBOARD_SIDE) {
+		internal_bitboard_set(&reached, y * BITBOARD_SIDE + x);
+	}
+	uint64_t r0 = reached.words[0], r1 = reached.words[1], r2 = reached.words[2], r3 = reached.words[3];
+	open0 |= r0;
+	open1 |= r1;
+	open2 |= r2;
+	open3 |= r3;
+
+	for (;;) {
+		uint64_t g0 = (r0 | internal_bitboard_sides(r0) | r0 << 16 | r0 >> 16 | r1 << 48) & open0;
+		uint64_t g1 = (r1 | internal_bitboard_sides(r1) | r1 << 16 | r0 >> 48 | r1 >> 16 | r2 << 48) & open1;
+		uint64_t g2 = (r2 | internal_bitboard_sides(r2) | r2 << 16 | r1 >> 48 | r2 >> 16 | r3 << 48) & open2;
+		uint64_t g3 = (r3 | internal_bitboard_sides(r3) | r3 << 16 | r2 >> 48 | r3 >> 16) & open3;
+		if (((g0 ^ r0) | (g1 ^ r1) | (g2 ^ r2) | (g3 ^ r3)) == 0) break;
+		r0 = g0;
+		r1 = g1;
+		r2 = g2;
+		r3 = g3;
+	}
+
+	reached.words[0] = r0;
+	reached.words[1] = r1;
+	reached.words[2] = r2;
+	reached.words[3] = r3;
+	if (region) {
+		*region = reached;
+	}
+	return bitboard_count(&reached);
+}
+
+int bitboard_count(const Bitboard *board)
+{
+	return __builtin_popcountll(board->words[0]) + __builtin_popcountll(board->words[1]) +
+		__builtin_popcountll(board->words[2]) + __builtin_popcountll(board->words[3]);
+}
@@ -5,9 +5,19 @@
 #define COLLECTIONS_INTERNAL
 #include "collections.h"
 
+size_t collections_queue_bytes(int capacity, int element_size)
+{
+	return sizeof(Queue) + (size_t)capacity * element_size;
+}
+
 Queue *collections_queue_create(int capacity, int element_size)
 {
-	Queue *queue = malloc(sizeof(*queue) + capacity * element_size);
+	return collections_queue_init(malloc(collections_queue_bytes(capacity, element_size)), capacity, element_size);
+}
+
+Queue *collections_queue_init(void *memory, int capacity, int element_size)
+{
+	Queue *queue = memory;
 	queue->element_size = element_size;
 	queue->capacity = capacity;
 	queue->size = 0;
@@ -50,12 +60,45 @@ void collections_queue_peek_last(Queue *q, void *pop)
 	memcpy(pop, &q->memory[q->rear * q->element_size], q->element_size);
 }
 
+void collections_queue_peek_first(Queue *q, void *peek)
+{
+	assert(q->size > 0);
+	memcpy(peek, &q->memory[q->front * q->element_size], q->element_size);
+}
+
 void collections_queue_pop_first(Queue *q)
 {
 	q->front = (q->front + 1) % q->capacity;
 	q->size--;
 }
 
+void collections_queue_copy_out(Queue *q, void *destination)
+{
+	int first = q->capacity - q->front < q->size ? q->capacity - q->front : q->size;
+	memcpy(destination, &q->memory[q->front * q->element_size], first * q->element_size);
+	memcpy((char *)destination + first * q->element_size, q->memory, (q->size - first) * q->element_size);
+}
+
+void collections_queue_copy_in(Queue *q, const void *source, int count)
+{
+	assert(count <= q->capacity);
+	memcpy(q->memory, source, count * q->element_size);
+	q->front = 0;
+	q->rear = count - 1;
+	q->size = count;
+}
+
+Queue *collections_queue_grow(Queue *q)
+{
+	Queue *grown = collections_queue_create(2 * q->capacity, q->element_size);
+	collections_queue_copy_out(q, grown->memory);
+	grown->rear = q->size - 1;
+	grown->size = q->size;
+	grown->callback_context = q->callback_context;
+	collections_queue_destroy(q);
+	return grown;
+}
+
 void collections_queue_empty(Queue *q)
 {
 	while (collections_queue_size(q) > 0) {
@@ -67,3 +110,303 @@ void collections_queue_destroy(Queue *q)
 {
 	free(q);
 }
+
+size_t collections_bitring_bytes(int capacity)
+{
+	return sizeof(BitRing) + (capacity + 3) / 4;
+}
+
+BitRing *collections_bitring_create(int capacity)
+{
+	return collections_bitring_init(malloc(collections_bitring_bytes(capacity)), capacity);
+}
+
+BitRing *collections_bitring_init(void *memory, int capacity)
+{
+	BitRing *r = memory;
+	memset(r, 0, collections_bitring_bytes(capacity));
+	r->capacity = capacity;
+	return r;
+}
+
+void collections_bitring_add(BitRing *r, unsigned code)
+{
+	assert(r->size < r->capacity);
+	int slot = (r->front + r->size) % r->capacity;
+	int shift = (slot & 3) * 2;
+	r->codes[slot >> 2] = (r->codes[slot >> 2] & ~(3 << shift)) | (code & 3) << shift;
+	r->size++;
+}
+
+unsigned collections_bitring_get(BitRing *r, int index)
+{
+	assert(index < r->size);
+	int slot = (r->front + index) % r->capacity;
+	return (r->codes[slot >> 2] >> ((slot & 3) * 2)) & 3;
+}
+
+void collections_bitring_pop_first(BitRing *r)
+{
+	assert(r->size > 0);
+	r->front = (r->front + 1) % r->capacity;
+	r->size--;
+}
+
+int collections_bitring_size(BitRing *r)
+{
+	return r->size;
+}
+
+/* Copies 'count' codes from code 'from' of 'source' to the start of 'destination', a byte at a time. */
+void internal_bitring_extract(uint8_t *destination, const uint8_t *source, int from, int count)
+{
+	const uint8_t *src = source + (from >> 2);
+	int bytes = (count + 3) / 4;
+	int shift = (from & 3) * 2;
+	if (shift == 0) {
+		memcpy(destination, src, bytes);
+		return;
+	}
+	for (int i = 0; i < bytes; ++i) {
+		destination[i] = src[i] >> shift;
+		/* Only read the next byte while it holds codes to copy, it may be past the ring. */
+		if ((from & 3) + count - 4 * i > 4) {
+			destination[i] |= src[i + 1] << (8 - shift);
+		}
+	}
+}
+
+/* Copies the first 'count' codes of 'source' to code 'to' of 'destination', keeping the codes before it. */
+void internal_bitring_append(uint8_t *destination, int to, const uint8_t *source, int count)
+{
+	uint8_t *dst = destination + (to >> 2);
+	int bytes = (count + 3) / 4;
+	int shift = (to & 3) * 2;
+	if (shift == 0) {
+		memcpy(dst, source, bytes);
+		return;
+	}
+	dst[0] = (dst[0] & ((1 << shift) - 1)) | source[0] << shift;
+	for (int i = 1; i < bytes; ++i) {
+		dst[i] = source[i - 1] >> (8 - shift) | source[i] << shift;
+	}
+	if (((to & 3) + count + 3) / 4 > bytes) {
+		dst[bytes] = source[bytes - 1] >> (8 - shift);
+	}
+}
+
+void collections_bitring_copy_out(BitRing *r, uint8_t *destination)
+{
+	/* The codes run from 'front' to the end of the ring, then wrap around to its start. */
+	int first = r->capacity - r->front < r->size ? r->capacity - r->front : r->size;
+	internal_bitring_extract(destination, r->codes, r->front, first);
+	if (r->size > first) {
+		internal_bitring_append(destination, first, r->codes, r->size - first);
+	}
+	if (r->size & 3) {
+		destination[r->size >> 2] &= (1 << (r->size & 3) * 2) - 1;
+	}
+}
+
+void collections_bitring_copy_in(BitRing *r, const uint8_t *source, int count)
+{
+	assert(count <= r->capacity);
+	memcpy(r->codes, source, (count + 3) / 4);
+	r->front = 0;
+	r->size = count;
+}
+
+BitRing *collections_bitring_grow(BitRing *r)
+{
+	BitRing *grown = collections_bitring_create(2 * r->capacity);
+	collections_bitring_copy_out(r, grown->codes);
+	grown->size = r->size;
+	collections_bitring_destroy(r);
+	return grown;
+}
+
+void collections_bitring_empty(BitRing *r)
+{
+	r->front = 0;
+	r->size = 0;
+}
+
+void collections_bitring_destroy(BitRing *r)
+{
+	free(r);
+}
+
+uint64_t internal_map_hash(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	return key;
+}
+
+Map *collections_map_create(int capacity)
+{
+	uint64_t size = 8;
+	while (size < 2 * (uint64_t)capacity) {
+		size <<= 1;
+	}
+
+	Map *m = calloc(1, sizeof(*m));
+	m->mask = size - 1;
+	m->entries = calloc(size, sizeof(*m->entries));
+	return m;
+}
+
+void *collections_map_get(Map *m, uint64_t key)
+{
+	for (uint64_t i = internal_map_hash(key) & m->mask;; i = (i + 1) & m->mask) {
+		if (!m->entries[i].value || m->entries[i].key == key) {
+			return m->entries[i].value;
+		}
+	}
+}
+
+void collections_map_put(Map *m, uint64_t key, void *value)
+{
+	assert(value != NULL);
+	if (2 * (uint64_t)(m->count + 1) > m->mask + 1) {
+		MapEntry *entries = m->entries;
+		uint64_t capacity = m->mask + 1;
+		m->mask = 2 * capacity - 1;
+		m->entries = calloc(2 * capacity, sizeof(*m->entries));
+		m->count = 0;
+		for (uint64_t i = 0; i < capacity; ++i) {
+			if (entries[i].value) {
+				collections_map_put(m, entries[i].key, entries[i].value);
+			}
+		}
+		free(entries);
+	}
+
+	for (uint64_t i = internal_map_hash(key) & m->mask;; i = (i + 1) & m->mask) {
+		if (!m->entries[i].value) {
+			m->entries[i].key = key;
+			m->entries[i].value = value;
+			m->count++;
+			return;
+		}
+		if (m->entries[i].key == key) {
+			m->entries[i].value = value;
+			return;
+		}
+	}
+}
+
+void *collections_map_remove(Map *m, uint64_t key)
+{
+	uint64_t i = internal_map_hash(key) & m->mask;
+	while (m->entries[i].value && m->entries[i].key != key) {
+		i = (i + 1) & m->mask;
+	}
+
+	void *value = m->entries[i].value;
+	if (!value) {
+		return NULL;
+	}
+
+	/* Shifts the following entries back so no probe sequence is broken by the hole. */
+	for (uint64_t j = (i + 1) & m->mask; m->entries[j].value; j = (j + 1) & m->mask) {
+		uint64_t home = internal_map_hash(m->entries[j].key) & m->mask;
+		if (((j - home) & m->mask) >= ((j - i) & m->mask)) {
+			m->entries[i] = m->entries[j];
+			i = j;
+		}
+	}
+	m->entries[i].value = NULL;
+	m->count--;
+	return value;
+}
+
+int collections_map_size(Map *m)
+{
+	return m->count;
+}
+
+void collections_map_foreach(Map *m, void func(void *value, void *context), void *context)
+{
+	for (uint64_t i = 0; i <= m->mask; ++i) {
+		if (m->entries[i].value) {
+			func(m->entries[i].value, context);
+		}
+	}
+}
+
+void collections_map_empty(Map *m)
+{
+	memset(m->entries, 0, (m->mask + 1) * sizeof(*m->entries));
+	m->count = 0;
+}
+
+void collections_map_destroy(Map *m)
+{
+	free(m->entries);
+	free(m);
+}
+
+#define TABLE_BUCKET 4 /* Slots probed per key */
+
+Table *collections_table_create(int capacity)
+{
+	uint64_t size = TABLE_BUCKET;
+	while (size < (uint64_t)capacity) {
+		size <<= 1;
+	}
+
+	Table *t = calloc(1, sizeof(*t) + size * sizeof(*t->entries));
+	t->mask = size - 1;
+	return t;
+}
+
+void collections_table_store(Table *t, uint64_t key, uint64_t value)
+{
+	if (key == 0) return;
+
+	/* An empty entry reads as key 0, so looking for the key or 0 finds either. */
+	uint64_t slot = TABLE_BUCKET;
+	for (uint64_t i = 0; i < TABLE_BUCKET; ++i) {
+		TableEntry *entry = &t->entries[(key + i) & t->mask];
+		uint64_t found = atomic_load_explicit(&entry->check, memory_order_relaxed) ^ atomic_load_explicit(&entry->value, memory_order_relaxed);
+		if (found == key || found == 0) {
+			slot = i;
+			break;
+		}
+	}
+	if (slot == TABLE_BUCKET) {
+		slot = atomic_fetch_add_explicit(&t->evictions, 1, memory_order_relaxed) % TABLE_BUCKET;
+	}
+
+	TableEntry *entry = &t->entries[(key + slot) & t->mask];
+	atomic_store_explicit(&entry->value, value, memory_order_relaxed);
+	atomic_store_explicit(&entry->check, key ^ value, memory_order_release);
+}
+
+int collections_table_probe(Table *t, uint64_t key, uint64_t *value)
+{
+	if (key == 0) return 0;
+
+	for (uint64_t i = 0; i < TABLE_BUCKET; ++i) {
+		TableEntry *entry = &t->entries[(key + i) & t->mask];
+		uint64_t check = atomic_load_explicit(&entry->check, memory_order_acquire);
+		uint64_t stored = atomic_load_explicit(&entry->value, memory_order_relaxed);
+		if ((check ^ stored) == key) {
+			*value = stored;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void collections_table_clear(Table *t)
+{
+	memset(t->entries, 0, (t->mask + 1) * sizeof(*t->entries));
+}
+
+void collections_table_destroy(Table *t)
+{
+	free(t);
+}
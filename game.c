@@ -6,6 +6,50 @@
 
 #define GAME_INTERNAL
 #include "game.h"
+#include "game_rules.h"
+#include "observe.h"
+
+/*
+ * Fixed part of a snapshot. It is followed by the body, tail first, then for dense games by one
+ * int per segment: the key held in the segment's hole of the free set, -1 if it has none.
+ */
+typedef struct GameSnapshot {
+	int started;
+	int flags;
+	int move_x, move_y;
+	int queued_move_x, queued_move_y;
+	int command_front, command_count;
+	GameSnakeDirection commands[GAME_COMMAND_CAPACITY];
+	int width, height;
+	int snake_x, snake_y;
+	int food_x, food_y;
+	int snake_length;
+	int body_size;
+	int64_t pushes;
+	int tail_x, tail_y;
+	int free_count;
+	Random random;
+	uint64_t hash;
+	int64_t ticks, start_tick;
+} GameSnapshot;
+
+#define CHUNK_SHIFT 6 /* Chunks are 64x64 cells */
+#define CHUNKED_BODY_CAPACITY 64
+#define GAME_BLOCK_ALIGN 16 /* Alignment of every part of a dense game's block */
+
+/* Occupancy of one chunk, one word per row. */
+typedef struct GameChunk {
+	int count; /* Occupied cells, the chunk is freed at 0 */
+	uint64_t rows[1 << CHUNK_SHIFT];
+} GameChunk;
+
+/* Kinds of Zobrist keys. */
+enum {
+	HASH_BODY,
+	HASH_HEAD,
+	HASH_FOOD,
+	HASH_DIRECTION,
+};
 
 
 int internal_is_inbounds(GameContext *game, int x, int y)
@@ -32,43 +76,478 @@ void internal_error_position_invalid(int line, int x, int y)
 	exit(-1);
 }
 
-void internal_is_inside_snake_foreach(void *arg, void *ctx)
+void internal_error_snapshot_mismatch(int line, int width, int height)
+{
+	fprintf(stderr, "%d: Attempting to restore a snapshot of a %dx%d game into a game of another size or kind.\n", line, width, height);
+	exit(-1);
+}
+
+void internal_error_observe_chunked(int line)
+{
+	fprintf(stderr, "%d: Attempting to observe a chunked game, observations need the whole map.\n", line);
+	exit(-1);
+}
+
+void internal_error_reach_chunked(int line)
+{
+	fprintf(stderr, "%d: Attempting to flood fill a chunked game, it keeps no occupancy of the whole map.\n", line);
+	exit(-1);
+}
+
+void internal_error_level_chunked(int line)
+{
+	fprintf(stderr, "%d: Attempting to put a level on a chunked game, levels need the whole map.\n", line);
+	exit(-1);
+}
+
+void internal_error_pool_chunked(int line)
+{
+	fprintf(stderr, "%d: Attempting to pool chunked games, their bodies grow.\n", line);
+	exit(-1);
+}
+
+void internal_error_pool_mismatch(int line)
+{
+	fprintf(stderr, "%d: Attempting to release a game to a pool it doesn't come from.\n", line);
+	exit(-1);
+}
+
+/* Zobrist key of a cell (or direction) for the given kind, mixed on the fly with splitmix64 instead of a table. */
+uint64_t internal_hash_key(int kind, int64_t index)
+{
+	uint64_t z = ((uint64_t)index << 2 | kind) * 0x9e3779b97f4a7c15ULL + 0x632be59bd9b4e5f5ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+uint64_t internal_hash_direction(int move_x, int move_y)
+{
+	return internal_hash_key(HASH_DIRECTION, 3 * (move_x + 1) + move_y + 1);
+}
+
+uint64_t internal_hash_head(GameContext *game)
+{
+	return internal_hash_key(HASH_HEAD, (int64_t)game->snake_y * game->width + game->snake_x);
+}
+
+uint64_t internal_hash_food(GameContext *game)
+{
+	if (game->food_x < 0) return 0;
+	return internal_hash_key(HASH_FOOD, (int64_t)game->food_y * game->width + game->food_x);
+}
+
+/* Returns the chunk holding a cell. Missing chunks are created if 'create' is set, NULL is returned otherwise. */
+GameChunk *internal_chunk_get(GameContext *game, int x, int y, int create)
+{
+	uint64_t key = (uint64_t)(uint32_t)(y >> CHUNK_SHIFT) << 32 | (uint32_t)(x >> CHUNK_SHIFT);
+	if (game->chunk && game->chunk_key == key) {
+		return game->chunk;
+	}
+
+	GameChunk *chunk = collections_map_get(game->chunks, key);
+	if (!chunk && create) {
+		chunk = calloc(1, sizeof(*chunk));
+		collections_map_put(game->chunks, key, chunk);
+	}
+	if (chunk) {
+		game->chunk_key = key;
+		game->chunk = chunk;
+	}
+	return chunk;
+}
+
+void internal_chunk_free(void *chunk, void *context)
+{
+	(void)context;
+	free(chunk);
+}
+
+/* Key of a cell in the free set. */
+int internal_free_key(GameContext *game, int x, int y)
+{
+	int cell = y * game->width + x;
+	return game->open_index ? game->open_index[cell] : cell;
+}
+
+void internal_occupancy_set(GameContext *game, int x, int y, int value)
+{
+	uint64_t bit = (uint64_t)1 << (x & 63);
+	if (!game->chunks) {
+		uint64_t *word = &game->occupancy[y * game->row_words + (x >> 6)];
+		*word = value ? (*word | bit) : (*word & ~bit);
+		return;
+	}
+
+	GameChunk *chunk = internal_chunk_get(game, x, y, value);
+	uint64_t *word = &chunk->rows[y & ((1 << CHUNK_SHIFT) - 1)];
+	if (value) {
+		*word |= bit;
+		chunk->count++;
+	} else if (--chunk->count > 0) {
+		*word &= ~bit;
+	} else {
+		collections_map_remove(game->chunks, game->chunk_key);
+		free(chunk);
+		game->chunk = NULL;
+	}
+}
+
+/* Leaves only the walls of the level occupied. */
+void internal_occupancy_clear(GameContext *game)
 {
-	int x = ((int *)ctx)[0];
-	int y = ((int *)ctx)[1];
-	int snake_x = ((int *)arg)[0];
-	int snake_y = ((int *)arg)[1];
-	((int *)ctx)[2] = ((int *)ctx)[2] || (snake_x == x && snake_y == y);
+	if (game->level) {
+		memcpy(game->occupancy, level_walls(game->level), game->height * game->row_words * sizeof(*game->occupancy));
+		return;
+	}
+	if (!game->chunks) {
+		memset(game->occupancy, 0, game->height * game->row_words * sizeof(*game->occupancy));
+		return;
+	}
+
+	collections_map_foreach(game->chunks, internal_chunk_free, NULL);
+	collections_map_empty(game->chunks);
+	game->chunk = NULL;
 }
 
 int internal_is_inside_snake(GameContext *game, int x, int y)
 {
-	int context[3] = { x, y, 0 };
-	collections_queue_callback_context_set(game->positions_queue, context);
-	collections_queue_foreach(game->positions_queue, internal_is_inside_snake_foreach);
+	if (!game->chunks) {
+		return (game->occupancy[y * game->row_words + (x >> 6)] >> (x & 63)) & 1;
+	}
+
+	GameChunk *chunk = internal_chunk_get(game, x, y, 0);
+	return chunk && (chunk->rows[y & ((1 << CHUNK_SHIFT) - 1)] >> (x & 63)) & 1;
+}
+
+/* Must be called before the head position is updated. */
+void internal_snake_push(GameContext *game, int x, int y)
+{
+	if (game->positions_queue) {
+		int xy[] = { x, y };
+		if (game->body_size == game->body_capacity) {
+			game->positions_queue = collections_queue_grow(game->positions_queue);
+			game->body_capacity *= 2;
+		}
+		collections_queue_add(game->positions_queue, xy);
+	} else if (game->body_size > 0) {
+		if (game->body_size - 1 == game->body_capacity) {
+			game->body_codes = collections_bitring_grow(game->body_codes);
+			game->body_capacity *= 2;
+		}
+		collections_bitring_add(game->body_codes, internal_body_code(x - game->snake_x, y - game->snake_y));
+	} else {
+		game->tail_x = x;
+		game->tail_y = y;
+	}
+	game->body_size++;
+	game->pushes++;
+	internal_occupancy_set(game, x, y, 1);
+	if (game->free_cells) {
+		internal_free_remove(game->free_cells, game->free_index, &game->free_count, internal_free_key(game, x, y));
+	}
+	game->hash ^= internal_hash_key(HASH_BODY, (int64_t)y * game->width + x);
+}
+
+/* Removes the tail and writes its position to 'xy'. */
+void internal_snake_pop(GameContext *game, int *xy)
+{
+	if (game->positions_queue) {
+		collections_queue_peek_first(game->positions_queue, xy);
+		collections_queue_pop_first(game->positions_queue);
+	} else {
+		unsigned code = collections_bitring_get(game->body_codes, 0);
+		collections_bitring_pop_first(game->body_codes);
+		xy[0] = game->tail_x;
+		xy[1] = game->tail_y;
+		game->tail_x += BODY_CODE_X[code];
+		game->tail_y += BODY_CODE_Y[code];
+	}
+	game->body_size--;
+	internal_occupancy_set(game, xy[0], xy[1], 0);
+	if (game->free_cells) {
+		internal_free_add(game->free_cells, game->free_index, &game->free_count, internal_free_key(game, xy[0], xy[1]));
+	}
+	game->hash ^= internal_hash_key(HASH_BODY, (int64_t)xy[1] * game->width + xy[0]);
+}
+
+/*
+ * Chunked worlds keep no free set. The map is assumed to be mostly empty, so cells are drawn
+ * until a free one comes up.
+ */
+void internal_respawn_food_chunked(GameContext *game)
+{
+	if (game->body_size == (int64_t)game->width * game->height) {
+		game->food_x = -1;
+		game->food_y = -1;
+		return;
+	}
 
-	return context[2];
+	do {
+		game->food_x = random_bounded(&game->random, game->width);
+		game->food_y = random_bounded(&game->random, game->height);
+	} while (internal_is_inside_snake(game, game->food_x, game->food_y));
+	game->hash ^= internal_hash_food(game);
 }
 
+/* Places the food on a uniformly chosen free cell or off the map if there are none. */
 void internal_respawn_food(GameContext *game)
 {
-	game->food_x = rand() % (game->width - 1);
-	game->food_y = rand() % (game->height - 1);
+	game->hash ^= internal_hash_food(game);
 
-	int nx = game->snake_x + game->move_x;
-	int ny = game->snake_y + game->move_y;
+	if (game->chunks) {
+		internal_respawn_food_chunked(game);
+		return;
+	}
 
-	if ((nx == game->food_x && ny == game->food_y) || internal_is_inside_snake(game, game->food_x, game->food_y)) {
-		internal_respawn_food(game);
+	if (game->free_count == 0) {
+		game->food_x = -1;
+		game->food_y = -1;
+		return;
+	}
+
+	int cell = game->free_cells[random_bounded(&game->random, game->free_count)];
+	if (game->open_cells) {
+		cell = game->open_cells[cell];
+	}
+	game->food_x = cell % game->width;
+	game->food_y = cell / game->width;
+	game->hash ^= internal_hash_food(game);
+}
+
+/* Calls 'func' with every body position, tail first. */
+void internal_body_foreach(GameContext *game, void func(void *context, void *arg), void *context)
+{
+	if (game->positions_queue) {
+		collections_queue_callback_context_set(game->positions_queue, context);
+		collections_queue_foreach(game->positions_queue, func);
+		return;
+	}
+
+	int xy[] = { game->tail_x, game->tail_y };
+	for (int i = 0; i < game->body_size; ++i) {
+		func(xy, context);
+		if (i + 1 < game->body_size) {
+			unsigned code = collections_bitring_get(game->body_codes, i);
+			xy[0] += BODY_CODE_X[code];
+			xy[1] += BODY_CODE_Y[code];
+		}
+	}
+}
+
+/* Takes a segment out of the occupancy and gives its hole in the free set its own key back. */
+void internal_body_vacate_segment(void *xy, void *context)
+{
+	GameContext *game = context;
+	int x = ((int *)xy)[0];
+	int y = ((int *)xy)[1];
+	internal_occupancy_set(game, x, y, 0);
+	int key = internal_free_key(game, x, y);
+	if (key < game->free_count) {
+		game->free_cells[key] = key;
+	}
+}
+
+/*
+ * Empties the occupancy, walls aside, and the free set of a dense game by walking the body, so it
+ * costs the length of the snake rather than the size of the map. The body itself is left alone.
+ */
+void internal_body_vacate(GameContext *game)
+{
+	if (game->chunks) {
+		internal_occupancy_clear(game);
+		return;
+	}
+	internal_body_foreach(game, internal_body_vacate_segment, game);
+	game->free_count = game->free_total;
+}
+
+/* Bytes a snapshot needs for the body. Kept a multiple of sizeof(int) so the holes stay aligned. */
+size_t internal_snapshot_body_size(GameContext *game, int body_size)
+{
+	if (game->positions_queue) {
+		return body_size * 2 * sizeof(int);
+	}
+	size_t packed = body_size > 0 ? (body_size - 1 + 3) / 4 : 0;
+	return (packed + sizeof(int) - 1) / sizeof(int) * sizeof(int);
+}
+
+GameContext *game_create(int width, int height, uint64_t seed)
+{
+	return game_create_ex(width, height, seed, 0);
+}
+
+size_t internal_align(size_t bytes)
+{
+	return (bytes + GAME_BLOCK_ALIGN - 1) & ~(size_t)(GAME_BLOCK_ALIGN - 1);
+}
+
+/* Bytes of a dense game together with its body, occupancy, flood fill rows and free set. */
+size_t internal_game_bytes(int width, int height, int flags)
+{
+	size_t cells = (size_t)width * height;
+	size_t body = (flags & GAME_COMPACT_BODY) ? collections_bitring_bytes(cells) : collections_queue_bytes(cells, 2 * sizeof(int));
+	size_t row_bytes = ((width + 63) / 64) * sizeof(uint64_t);
+	return internal_align(sizeof(GameContext)) + internal_align(body) + internal_align(height * row_bytes)
+		+ internal_align(2 * height * row_bytes) + 2 * internal_align(cells * sizeof(int));
+}
+
+/* Lays out a dense game in 'block', which holds internal_game_bytes bytes. */
+GameContext *internal_game_init(void *block, int width, int height, uint64_t seed, int flags)
+{
+	GameContext *game = block;
+	memset(game, 0, sizeof(*game));
+	game->width = width;
+	game->height = height;
+	game->flags = flags;
+	random_seed(&game->random, seed);
+	game->body_capacity = width * height;
+
+	char *next = (char *)block + internal_align(sizeof(*game));
+	if (flags & GAME_COMPACT_BODY) {
+		game->body_codes = collections_bitring_init(next, game->body_capacity);
+		next += internal_align(collections_bitring_bytes(game->body_capacity));
+	} else {
+		game->positions_queue = collections_queue_init(next, game->body_capacity, 2 * sizeof(int));
+		next += internal_align(collections_queue_bytes(game->body_capacity, 2 * sizeof(int)));
 	}
+
+	game->row_words = (width + 63) / 64;
+	game->occupancy = (uint64_t *)next;
+	next += internal_align(height * game->row_words * sizeof(*game->occupancy));
+	game->reach = (uint64_t *)next;
+	next += internal_align(2 * height * game->row_words * sizeof(*game->reach));
+	game->free_cells = (int *)next;
+	next += internal_align(width * height * sizeof(*game->free_cells));
+	game->free_index = (int *)next;
+
+	memset(game->occupancy, 0, height * game->row_words * sizeof(*game->occupancy));
+	game->free_total = width * height;
+	game->free_count = game->free_total;
+	for (int i = 0; i < game->free_total; ++i) {
+		game->free_cells[i] = i;
+		game->free_index[i] = i;
+	}
+	return game;
 }
 
-GameContext *game_create(int width, int height)
+GameContext *game_create_ex(int width, int height, uint64_t seed, int flags)
 {
+	if (!(flags & GAME_CHUNKED)) {
+		return internal_game_init(malloc(internal_game_bytes(width, height, flags)), width, height, seed, flags);
+	}
+
+	/* The body of a chunked game grows, so it lives apart from the context. */
 	GameContext *game = calloc(1, sizeof(*game));
 	game->width = width;
 	game->height = height;
-	game->positions_queue = collections_queue_create(width * height, 2 * sizeof(int));
+	game->flags = flags;
+	random_seed(&game->random, seed);
+	game->body_capacity = CHUNKED_BODY_CAPACITY;
+	if (flags & GAME_COMPACT_BODY) {
+		game->body_codes = collections_bitring_create(game->body_capacity);
+	} else {
+		game->positions_queue = collections_queue_create(game->body_capacity, 2 * sizeof(int));
+	}
+	game->chunks = collections_map_create(16);
+	return game;
+}
+
+GamePool *game_pool_create(int width, int height, int flags, int slab_games)
+{
+	if (flags & GAME_CHUNKED) internal_error_pool_chunked(__LINE__);
+
+	GamePool *pool = calloc(1, sizeof(*pool));
+	pool->width = width;
+	pool->height = height;
+	pool->flags = flags;
+	pool->stride = internal_game_bytes(width, height, flags);
+	pool->slab_games = slab_games > 0 ? slab_games : 64;
+	return pool;
+}
+
+/*
+ * Gets a released game ready to be acquired again: everything game_start doesn't set goes back to
+ * how internal_game_init leaves it. The last body stays until game_start walks it away, so this
+ * costs the same on any map.
+ */
+void internal_game_recycle(GameContext *game, GamePool *pool, uint64_t seed)
+{
+	game->started = 0;
+	game->flags = pool->flags;
+	game->ticks = 0;
+	game->move_x = 0;
+	game->move_y = 0;
+	game->queued_move_x = 0;
+	game->queued_move_y = 0;
+	game->command_front = 0;
+	game->command_count = 0;
+	game->command_max_depth = 0;
+	game->command_drops = 0;
+	game->food_x = 0;
+	game->food_y = 0;
+	game->snake_length = 0;
+	game->callback_context = NULL;
+	game->start_tick = 0;
+	random_seed(&game->random, seed);
+	game->hash = 0;
+	game->pool = pool;
+}
+
+GameContext *game_pool_acquire(GamePool *pool, uint64_t seed)
+{
+	if (!pool->free) {
+		if (pool->slab_count == pool->slab_capacity) {
+			pool->slab_capacity = pool->slab_capacity ? 2 * pool->slab_capacity : 8;
+			pool->slabs = realloc(pool->slabs, pool->slab_capacity * sizeof(*pool->slabs));
+		}
+		char *slab = malloc(pool->slab_games * pool->stride);
+		pool->slabs[pool->slab_count++] = slab;
+		for (int i = pool->slab_games - 1; i >= 0; --i) {
+			/* Laid out once here, acquiring only recycles. The link overwrites fields that get reset. */
+			GamePoolBlock *block = (GamePoolBlock *)(slab + i * pool->stride);
+			internal_game_init(block, pool->width, pool->height, 0, pool->flags);
+			block->next = pool->free;
+			pool->free = block;
+		}
+	}
+
+	GamePoolBlock *block = pool->free;
+	pool->free = block->next;
+	GameContext *game = (GameContext *)block;
+	internal_game_recycle(game, pool, seed);
+	return game;
+}
+
+void game_pool_release(GamePool *pool, GameContext *game)
+{
+	if (game->pool != pool) internal_error_pool_mismatch(__LINE__);
+
+	GamePoolBlock *block = (GamePoolBlock *)game;
+	block->next = pool->free;
+	pool->free = block;
+}
+
+void game_pool_destroy(GamePool *pool)
+{
+	for (int i = 0; i < pool->slab_count; ++i) {
+		free(pool->slabs[i]);
+	}
+	free(pool->slabs);
+	free(pool);
+}
+
+GameContext *game_create_level(const Level *level, uint64_t seed, int flags)
+{
+	if (flags & GAME_CHUNKED) internal_error_level_chunked(__LINE__);
+
+	GameContext *game = game_create_ex(level_width(level), level_height(level), seed, flags);
+	game->level = level;
+	game->open_cells = level_open_cells(level);
+	game->open_index = level_open_index(level);
+	game->free_total = game->width * game->height - level_wall_count(level);
+	game->free_count = game->free_total;
+	internal_occupancy_clear(game);
 	return game;
 }
 
@@ -76,114 +555,579 @@ void game_start(GameContext *game, int snake_x, int snake_y)
 {
 	if (game->started) internal_error_already_started(__LINE__);
 	if (!internal_is_inbounds(game, snake_x, snake_y)) internal_error_position_invalid(__LINE__, snake_x, snake_y);
+	if (game->level && level_is_wall(game->level, snake_x, snake_y)) internal_error_position_invalid(__LINE__, snake_x, snake_y);
 
 	game->snake_x = snake_x;
 	game->snake_y = snake_y;
 	game->move_x = 0;
 	game->move_y = 0;
+	game->queued_move_x = 0;
+	game->queued_move_y = 0;
+	game->command_front = 0;
+	game->command_count = 0;
 	game->snake_length = 2;
 	game->started = 1;
-	internal_respawn_food(game);
+	game->start_tick = game->ticks;
+	game->food_x = -1;
+	game->food_y = -1;
+	game->hash = internal_hash_direction(0, 0) ^ internal_hash_head(game);
 
-	collections_queue_empty(game->positions_queue);
+	internal_body_vacate(game);
+	if (game->positions_queue) {
+		collections_queue_empty(game->positions_queue);
+	} else {
+		collections_bitring_empty(game->body_codes);
+	}
+	game->body_size = 0;
+	game->pushes = 0;
+	internal_snake_push(game, snake_x, snake_y);
 
-	int xy[] = { snake_x, snake_y };
-	collections_queue_add(game->positions_queue, xy);
+	internal_respawn_food(game);
 }
 
 int game_update(GameContext *game)
 {
+	return game_update_ex(game, NULL);
+}
+
+int game_update_ex(GameContext *game, GameDelta *delta)
+{
+	GameDelta ignored;
+	if (!delta) delta = &ignored;
+	memset(delta, 0, sizeof(*delta));
+
 	if (!game->started) internal_error_not_started(__LINE__);
+	game->ticks++;
+
+	if (game->command_count > 0) {
+		uint64_t old_direction = internal_hash_direction(game->move_x, game->move_y);
+		internal_direction_apply(&game->move_x, &game->move_y, game->commands[game->command_front]);
+		game->command_front = (game->command_front + 1) % GAME_COMMAND_CAPACITY;
+		game->command_count--;
+		game->hash ^= old_direction ^ internal_hash_direction(game->move_x, game->move_y);
+	}
+
 	if (game->move_x + game->move_y == 0) return 0;
 
 	int new_x = game->snake_x + game->move_x;
 	int new_y = game->snake_y + game->move_y;
 
-	if (!internal_is_inbounds(game, new_x, new_y)) {
-		game->started = 0;
-		return 1;
-	}
-
-	if (internal_is_inside_snake(game, new_x, new_y)) {
+	if (!internal_is_inbounds(game, new_x, new_y) || internal_is_inside_snake(game, new_x, new_y)) {
 		game->started = 0;
+		delta->died = 1;
 		return 1;
 	}
 
-	if (new_x == game->food_x && new_y == game->food_y)
-	{
+	int ate = new_x == game->food_x && new_y == game->food_y;
+	if (ate) {
 		game->snake_length++;
-		internal_respawn_food(game);
 	}
 
-	if (collections_queue_size(game->positions_queue) >= game->snake_length) {
-		collections_queue_pop_first(game->positions_queue);
+	if (game->body_size >= game->snake_length) {
+		int tail[2];
+		internal_snake_pop(game, tail);
+		delta->tail_removed = 1;
+		delta->tail_x = tail[0];
+		delta->tail_y = tail[1];
 	}
 
+	internal_snake_push(game, new_x, new_y);
+	game->hash ^= internal_hash_head(game);
 	game->snake_x = new_x;
 	game->snake_y = new_y;
-	int positions[] = { new_x, new_y };
-	collections_queue_add(game->positions_queue, &positions);
+	game->hash ^= internal_hash_head(game);
+	delta->moved = 1;
+	delta->head_x = new_x;
+	delta->head_y = new_y;
+
+	if (ate) {
+		internal_respawn_food(game);
+		delta->food_moved = 1;
+		delta->food_from_x = new_x;
+		delta->food_from_y = new_y;
+		delta->food_to_x = game->food_x;
+		delta->food_to_y = game->food_y;
+	}
+
+	return 0;
+}
+
+/*
+ * Returns the straight moves, up to 'limit', the head can make before its next cell is outside
+ * the map, a wall, the body or the food. Cells the tail would free on the way are treated as
+ * taken, so the run stops early rather than late.
+ */
+int64_t internal_straight_run(GameContext *game, int64_t limit)
+{
+	int64_t run = 0;
+	if (!game->chunks && game->move_y == 0) {
+		/* Along a row whole occupancy words are scanned at once. */
+		const uint64_t *row = game->occupancy + game->snake_y * game->row_words;
+		int x = game->snake_x + game->move_x;
+		int food = game->food_y == game->snake_y ? game->food_x : -1;
+		while (run < limit && x >= 0 && x < game->width) {
+			uint64_t word = row[x >> 6];
+			if (food >= 0 && (food >> 6) == (x >> 6)) word |= (uint64_t)1 << (food & 63);
+			int stop;
+			if (game->move_x > 0) {
+				word &= ~(uint64_t)0 << (x & 63);
+				stop = word ? (x & ~63) + __builtin_ctzll(word) : (x | 63) + 1;
+				if (stop > game->width) stop = game->width;
+				run += stop - x;
+				x = stop;
+			} else {
+				word &= ~(uint64_t)0 >> (63 - (x & 63));
+				stop = word ? (x & ~63) + 63 - __builtin_clzll(word) : (x & ~63) - 1;
+				run += x - stop;
+				x = stop;
+			}
+			if (word) break;
+		}
+		return run < limit ? run : limit;
+	}
+
+	int x = game->snake_x + game->move_x, y = game->snake_y + game->move_y;
+	while (run < limit && internal_is_inbounds(game, x, y) && !internal_is_inside_snake(game, x, y) &&
+		(x != game->food_x || y != game->food_y)) {
+		run++;
+		x += game->move_x;
+		y += game->move_y;
+	}
+	return run;
+}
+
+/* Moves the head 'run' cells straight on. The caller has checked that nothing happens on the way. */
+void internal_straight_apply(GameContext *game, int64_t run)
+{
+	game->hash ^= internal_hash_head(game);
+	for (int64_t i = 0; i < run; ++i) {
+		int new_x = game->snake_x + game->move_x;
+		int new_y = game->snake_y + game->move_y;
+		if (game->body_size >= game->snake_length) {
+			int tail[2];
+			internal_snake_pop(game, tail);
+		}
+		internal_snake_push(game, new_x, new_y);
+		game->snake_x = new_x;
+		game->snake_y = new_y;
+	}
+	game->hash ^= internal_hash_head(game);
+	game->ticks += run;
+}
 
+int game_advance(GameContext *game, int64_t max_ticks)
+{
+	if (!game->started) internal_error_not_started(__LINE__);
+
+	while (max_ticks > 0) {
+		if (game->command_count == 0) {
+			if (game->move_x + game->move_y == 0) {
+				game->ticks += max_ticks;
+				return 0;
+			}
+			int64_t run = internal_straight_run(game, max_ticks);
+			internal_straight_apply(game, run);
+			max_ticks -= run;
+			if (max_ticks == 0) break;
+		}
+		/* A queued turn, the food or a collision: the next tick takes the full update. */
+		if (game_update(game)) return 1;
+		max_ticks--;
+	}
 	return 0;
 }
 
+int game_snake_length(GameContext *game)
+{
+	return game->snake_length;
+}
+
+int64_t game_ticks(GameContext *game)
+{
+	return game->ticks;
+}
+
+/* Cell of the tail, -1 without a body. */
+int internal_tail_cell(GameContext *game)
+{
+	if (game->body_size == 0) return -1;
+	if (game->positions_queue) {
+		int xy[2];
+		collections_queue_peek_first(game->positions_queue, xy);
+		return xy[1] * game->width + xy[0];
+	}
+	return game->tail_y * game->width + game->tail_x;
+}
+
+void internal_game_observe_body(void *source, void func(void *xy, void *context), void *context)
+{
+	internal_body_foreach(source, func, context);
+}
+
+size_t game_observe_size(GameContext *game, const GameObserveLayout *layout)
+{
+	return observe_size(game->width, game->height, layout);
+}
+
+void game_observe(GameContext *game, GameObserveLayout *layout, void *dst)
+{
+	if (game->flags & GAME_CHUNKED) internal_error_observe_chunked(__LINE__);
+
+	ObserveFrame frame = {
+		game->width, game->height,
+		game->snake_y * game->width + game->snake_x,
+		game->food_x < 0 ? -1 : game->food_y * game->width + game->food_x,
+		internal_tail_cell(game),
+		game->body_size, game->pushes, game->ticks, game->start_tick,
+		game->level ? level_walls(game->level) : NULL,
+		internal_game_observe_body, game,
+	};
+	observe_write(&frame, layout, dst);
+}
+
+/*
+ * Grows 'row' to the whole runs of 'open' bits it touches. Carries run from word to word:
+ * rightwards an addition pushes every seed to the top of its run, leftwards a Kogge-Stone
+ * fill pulls the top of every run down to its start.
+ */
+void internal_reach_row(uint64_t *row, const uint64_t *open, int words)
+{
+	uint64_t carry = 0;
+	for (int i = 0; i < words; ++i) {
+		uint64_t sum;
+		uint64_t out = __builtin_add_overflow(open[i], row[i], &sum);
+		out |= __builtin_add_overflow(sum, carry, &sum);
+		row[i] |= (sum ^ open[i]) & open[i];
+		carry = out;
+	}
+
+	uint64_t top = 0;
+	for (int i = words - 1; i >= 0; --i) {
+		uint64_t g = row[i] | (top & open[i]), p = open[i];
+		g |= p & (g >> 1);
+		p &= p >> 1;
+		g |= p & (g >> 2);
+		p &= p >> 2;
+		g |= p & (g >> 4);
+		p &= p >> 4;
+		g |= p & (g >> 8);
+		p &= p >> 8;
+		g |= p & (g >> 16);
+		p &= p >> 16;
+		g |= p & (g >> 32);
+		row[i] = g;
+		top = (g & 1) << 63;
+	}
+}
+
+/* Takes in the cells of the rows next to 'y' and fills the row. Returns 1 if it grew. */
+int internal_reach_sweep_row(GameContext *game, int y)
+{
+	int words = game->row_words;
+	uint64_t *row = game->reach + y * words;
+	const uint64_t *open = game->reach + (game->height + y) * words;
+	const uint64_t *above = y + 1 < game->height ? row + words : NULL;
+	const uint64_t *below = y > 0 ? row - words : NULL;
+
+	uint64_t grown = 0;
+	for (int i = 0; i < words; ++i) {
+		uint64_t next = row[i] | (((above ? above[i] : 0) | (below ? below[i] : 0)) & open[i]);
+		grown |= next ^ row[i];
+		row[i] = next;
+	}
+	if (!grown) return 0;
+
+	internal_reach_row(row, open, words);
+	return 1;
+}
+
+int game_reachable(GameContext *game, int x, int y, int *tail_reachable)
+{
+	if (game->flags & GAME_CHUNKED) internal_error_reach_chunked(__LINE__);
+	if (tail_reachable) *tail_reachable = 0;
+	if (!internal_is_inbounds(game, x, y)) return 0;
+
+	/* The reached cells, then the open ones: neither occupied nor past the width, plus the seed. */
+	int words = game->row_words;
+	uint64_t *open = game->reach + game->height * words;
+	memset(game->reach, 0, game->height * words * sizeof(*game->reach));
+	for (int i = 0; i < game->height * words; ++i) {
+		open[i] = ~game->occupancy[i];
+	}
+	if (game->width & 63) {
+		for (int row = 0; row < game->height; ++row) {
+			open[row * words + words - 1] &= ((uint64_t)1 << (game->width & 63)) - 1;
+		}
+	}
+	uint64_t seed = (uint64_t)1 << (x & 63);
+	open[y * words + (x >> 6)] |= seed;
+	game->reach[y * words + (x >> 6)] = seed;
+	internal_reach_row(game->reach + y * words, open + y * words, words);
+
+	/* Sweeps up then down until a pair of sweeps adds nothing. A path needs one sweep per vertical turn. */
+	for (int grown = 1; grown;) {
+		grown = 0;
+		for (int row = 1; row < game->height; ++row) {
+			grown |= internal_reach_sweep_row(game, row);
+		}
+		for (int row = game->height - 2; row >= 0; --row) {
+			grown |= internal_reach_sweep_row(game, row);
+		}
+	}
+
+	int cells = 0;
+	for (int i = 0; i < game->height * words; ++i) {
+		cells += __builtin_popcountll(game->reach[i]);
+	}
+
+	if (tail_reachable && game->body_size > 0) {
+		int tail[2];
+		if (game->positions_queue) {
+			collections_queue_peek_first(game->positions_queue, tail);
+		} else {
+			tail[0] = game->tail_x;
+			tail[1] = game->tail_y;
+		}
+		const int dx[] = { 0, 1, -1, 0, 0 };
+		const int dy[] = { 0, 0, 0, 1, -1 };
+		for (int d = 0; d < 5; ++d) {
+			int nx = tail[0] + dx[d], ny = tail[1] + dy[d];
+			if (internal_is_inbounds(game, nx, ny) && (game->reach[ny * words + (nx >> 6)] >> (nx & 63)) & 1) {
+				*tail_reachable = 1;
+				break;
+			}
+		}
+	}
+	return cells;
+}
+
+uint64_t game_hash(GameContext *game)
+{
+	return game->hash;
+}
+
 void game_get_food(GameContext *game, int *position)
 {
 	position[0] = game->food_x;
 	position[1] = game->food_y;
 }
 
+void game_get_head(GameContext *game, int *position)
+{
+	position[0] = game->snake_x;
+	position[1] = game->snake_y;
+}
+
+void game_get_move(GameContext *game, int *move)
+{
+	move[0] = game->queued_move_x;
+	move[1] = game->queued_move_y;
+}
+
+int game_is_blocked(GameContext *game, int x, int y)
+{
+	return !internal_is_inbounds(game, x, y) || internal_is_inside_snake(game, x, y);
+}
+
 void game_callback_context_set(GameContext *game, void *context)
 {
-	collections_queue_callback_context_set(game->positions_queue, context);
+	game->callback_context = context;
 }
 
 void game_snake_foreach(GameContext *game, void func(void *context, void *arg))
 {
-	collections_queue_foreach(game->positions_queue, func);
+	internal_body_foreach(game, func, game->callback_context);
+}
+
+void game_body_foreach(GameContext *game, void func(void *xy, void *context), void *context)
+{
+	internal_body_foreach(game, func, context);
 }
 
 int game_set_snake_direction(GameContext *game, GameSnakeDirection direction)
 {
 	if (!game->started) internal_error_not_started(__LINE__);
-	switch (direction) {
-		case GSD_UP:
-		{
-			if (abs(game->move_y) == 1) return 0;
-			game->move_y = 1;
-			game->move_x = 0;
-			break;
-		}
-		case GSD_DOWN:
-		{
-			if (abs(game->move_y) == 1) return 0;
-			game->move_y = -1;
-			game->move_x = 0;
-			break;
-		}
-		case GSD_RIGHT:
-		{
-			if (abs(game->move_x) == 1) return 0;
-			game->move_y = 0;
-			game->move_x = 1;
-			break;
-		}
-		case GSD_LEFT:
-		{
-			if (abs(game->move_x) == 1) return 0;
-			game->move_y = 0;
-			game->move_x = -1;
-			break;
-		}
-                case GSD_NONE:
-			return 0;
-                }
 
-        return 1;
+	/* Turns are checked against the direction the snake will have once every queued turn is applied. */
+	if (!internal_direction_apply(&game->queued_move_x, &game->queued_move_y, direction)) {
+		return 0;
+	}
+
+	if (game->command_count == GAME_COMMAND_CAPACITY) {
+		/* Undo the prediction, the turn is lost. */
+		int slot = (game->command_front + game->command_count - 1) % GAME_COMMAND_CAPACITY;
+		game->queued_move_x = 0;
+		game->queued_move_y = 0;
+		internal_direction_apply(&game->queued_move_x, &game->queued_move_y, game->commands[slot]);
+		game->command_drops++;
+		return 0;
+	}
+
+	game->commands[(game->command_front + game->command_count++) % GAME_COMMAND_CAPACITY] = direction;
+	if (game->command_count > game->command_max_depth) {
+		game->command_max_depth = game->command_count;
+	}
+	return 1;
+}
+
+void game_input_stats(GameContext *game, GameInputStats *stats)
+{
+	stats->depth = game->command_count;
+	stats->max_depth = game->command_max_depth;
+	stats->drops = game->command_drops;
+}
+
+size_t game_snapshot_size(GameContext *game)
+{
+	return sizeof(GameSnapshot) +
+		internal_snapshot_body_size(game, game->body_size) +
+		(game->free_cells ? game->body_size * sizeof(int) : 0);
+}
+
+typedef struct {
+	GameContext *game;
+	int *out;          /* Next hole to save */
+	const int *in;     /* Next hole to restore */
+} SnapshotHoles_callback;
+
+void internal_snapshot_holes_save(void *xy, void *context)
+{
+	SnapshotHoles_callback *instance = context;
+	GameContext *game = instance->game;
+	int key = internal_free_key(game, ((int *)xy)[0], ((int *)xy)[1]);
+	*instance->out++ = key < game->free_count ? game->free_cells[key] : -1;
+}
+
+/* Occupies a segment and puts back what its hole in the free set held. */
+void internal_snapshot_holes_restore(void *xy, void *context)
+{
+	SnapshotHoles_callback *instance = context;
+	GameContext *game = instance->game;
+	int x = ((int *)xy)[0];
+	int y = ((int *)xy)[1];
+	internal_occupancy_set(game, x, y, 1);
+	if (!game->free_cells) {
+		return;
+	}
+	int held = *instance->in++;
+	if (held >= 0) {
+		int key = internal_free_key(game, x, y);
+		game->free_cells[key] = held;
+		game->free_index[held] = key;
+	}
+}
+
+void game_snapshot_save(GameContext *game, void *buffer)
+{
+	GameSnapshot *snapshot = buffer;
+	snapshot->started = game->started;
+	snapshot->flags = game->flags;
+	snapshot->move_x = game->move_x;
+	snapshot->move_y = game->move_y;
+	snapshot->queued_move_x = game->queued_move_x;
+	snapshot->queued_move_y = game->queued_move_y;
+	snapshot->command_front = game->command_front;
+	snapshot->command_count = game->command_count;
+	memcpy(snapshot->commands, game->commands, sizeof(game->commands));
+	snapshot->width = game->width;
+	snapshot->height = game->height;
+	snapshot->snake_x = game->snake_x;
+	snapshot->snake_y = game->snake_y;
+	snapshot->food_x = game->food_x;
+	snapshot->food_y = game->food_y;
+	snapshot->snake_length = game->snake_length;
+	snapshot->body_size = game->body_size;
+	snapshot->pushes = game->pushes;
+	snapshot->tail_x = game->tail_x;
+	snapshot->tail_y = game->tail_y;
+	snapshot->free_count = game->free_count;
+	snapshot->random = game->random;
+	snapshot->hash = game->hash;
+	snapshot->ticks = game->ticks;
+	snapshot->start_tick = game->start_tick;
+
+	/*
+	 * The order of the free set decides where food spawns next, so it is part of the state.
+	 * Outside the holes left by the body it follows from free_count, see game_rules.h, so only
+	 * the holes are kept.
+	 */
+	char *body = (char *)(snapshot + 1);
+	if (game->positions_queue) {
+		collections_queue_copy_out(game->positions_queue, body);
+	} else {
+		collections_bitring_copy_out(game->body_codes, (uint8_t *)body);
+	}
+	if (game->free_cells) {
+		SnapshotHoles_callback holes = { game, (int *)(body + internal_snapshot_body_size(game, game->body_size)), NULL };
+		internal_body_foreach(game, internal_snapshot_holes_save, &holes);
+	}
+}
+
+void game_snapshot_restore(GameContext *game, const void *buffer)
+{
+	const GameSnapshot *snapshot = buffer;
+	if (snapshot->width != game->width || snapshot->height != game->height || snapshot->flags != game->flags) {
+		internal_error_snapshot_mismatch(__LINE__, snapshot->width, snapshot->height);
+	}
+
+	/* Undo the current body first, while it is still there to walk. */
+	internal_body_vacate(game);
+
+	game->started = snapshot->started;
+	game->move_x = snapshot->move_x;
+	game->move_y = snapshot->move_y;
+	game->queued_move_x = snapshot->queued_move_x;
+	game->queued_move_y = snapshot->queued_move_y;
+	game->command_front = snapshot->command_front;
+	game->command_count = snapshot->command_count;
+	memcpy(game->commands, snapshot->commands, sizeof(game->commands));
+	game->snake_x = snapshot->snake_x;
+	game->snake_y = snapshot->snake_y;
+	game->food_x = snapshot->food_x;
+	game->food_y = snapshot->food_y;
+	game->snake_length = snapshot->snake_length;
+	game->pushes = snapshot->pushes;
+	game->random = snapshot->random;
+	game->hash = snapshot->hash;
+	game->ticks = snapshot->ticks;
+	game->start_tick = snapshot->start_tick;
+	game->tail_x = snapshot->tail_x;
+	game->tail_y = snapshot->tail_y;
+
+	const char *body = (const char *)(snapshot + 1);
+	while (game->body_capacity < snapshot->body_size) {
+		if (game->positions_queue) {
+			game->positions_queue = collections_queue_grow(game->positions_queue);
+		} else {
+			game->body_codes = collections_bitring_grow(game->body_codes);
+		}
+		game->body_capacity *= 2;
+	}
+	if (game->positions_queue) {
+		collections_queue_copy_in(game->positions_queue, body, snapshot->body_size);
+	} else {
+		collections_bitring_copy_in(game->body_codes, (const uint8_t *)body, snapshot->body_size > 0 ? snapshot->body_size - 1 : 0);
+	}
+	game->body_size = snapshot->body_size;
+	game->free_count = snapshot->free_count;
+	SnapshotHoles_callback holes = { game, NULL, (const int *)(body + internal_snapshot_body_size(game, snapshot->body_size)) };
+	internal_body_foreach(game, internal_snapshot_holes_restore, &holes);
 }
 
 void game_destroy(GameContext *game)
 {
-	collections_queue_destroy(game->positions_queue);
+	if (game->pool) {
+		game_pool_release(game->pool, game);
+		return;
+	}
+	if (game->chunks) {
+		if (game->positions_queue) {
+			collections_queue_destroy(game->positions_queue);
+		} else {
+			collections_bitring_destroy(game->body_codes);
+		}
+		internal_occupancy_clear(game);
+		collections_map_destroy(game->chunks);
+	}
 	free(game);
 }
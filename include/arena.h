@@ -0,0 +1,97 @@
+#ifndef ARENA
+#define ARENA
+
+#include <stdint.h>
+#include "game.h"
+
+#ifdef ARENA_INTERNAL
+
+#include "collections.h"
+#include "random.h"
+
+/*
+ * Many snakes on one map, playing by the rules of game.c. Every cell of 'grid' tells which snake
+ * covers it, so a head checks against all bodies with one lookup. Heads claim their target cell in
+ * 'claim_tick' / 'claim_snake', which resolves head to head collisions without comparing heads pairwise.
+ */
+typedef struct Arena {
+	int width, height;
+	int cells;          /* width * height */
+	int snake_count;
+	int food_target;    /* Food kept on the map */
+	int food_count;     /* Food currently on the map */
+	int tick;
+
+	int *grid;          /* 0 free, -1 food, otherwise the snake index + 1 */
+	int *claim_tick;    /* Tick in which a head last claimed the cell */
+	int *claim_snake;   /* Snake that claimed it */
+	int free_count;     /* Cells that are neither snake nor food */
+	int *free_cells;
+	int *free_index;
+
+	int *snake_x, *snake_y; /* Head positions */
+	int *move_x, *move_y;
+	int *snake_length;
+	int *body_capacity;
+	Queue **bodies;         /* Cells of every snake, tail first */
+
+	int moving_count;       /* Snakes with a direction, only these cost time in arena_update */
+	int *moving;
+	int *moving_slot;       /* Slot of every snake in 'moving' or -1 */
+	int *target;            /* Scratch: target cell of every moving snake, -1 if it leaves the map */
+	unsigned char *dead;    /* Scratch: set for snakes that die this tick */
+	int *waiting;           /* Snakes off the map until a cell frees up, oldest first */
+	int waiting_count;
+	Random random;
+} Arena;
+#endif
+
+#ifndef ARENA_INTERNAL
+typedef void Arena;
+#endif
+
+/*
+ * Creates an arena with 'snakes' snakes spawned on random free cells and 'food' pieces of food.
+ */
+Arena *arena_create(int width, int height, int snakes, int food, uint64_t seed);
+
+/*
+ * Changes the direction of a snake like game_set_snake_direction. Returns 1 if it changed, never while it waits to respawn.
+ */
+int arena_set_direction(Arena *arena, int snake, GameSnakeDirection direction);
+
+/*
+ * Moves every snake that has a direction. A snake dies if its head leaves the map, enters any body
+ * (as it was before the tick) or enters the same cell as another head. Dead snakes respawn standing
+ * still on a random free cell, and eaten food is replaced, in the same call. When the map has no
+ * free cell left, a snake waits off the map and respawns in a later call instead.
+ * Writes the indices of the snakes that died to 'died' (room for every snake) and returns their number.
+ */
+int arena_update(Arena *arena, int *died);
+
+/*
+ * Gets the head position of a snake, (-1, -1) while it waits to respawn.
+ */
+void arena_snake_get(Arena *arena, int snake, int *position);
+
+/*
+ * Returns the length of a snake.
+ */
+int arena_snake_length(Arena *arena, int snake);
+
+/*
+ * Calls 'func' with the (x, y) position of every segment of a snake, tail first.
+ */
+void arena_snake_foreach(Arena *arena, int snake, void func(void *arg, void *context), void *context);
+
+/*
+ * Returns 0 for a free cell, -1 for food and the snake index + 1 for a body.
+ */
+int arena_cell(Arena *arena, int x, int y);
+
+/*
+ * Destroys the arena.
+ */
+void arena_destroy(Arena *arena);
+
+#endif // !ARENA
@@ -0,0 +1,64 @@
+#ifndef AUTOPILOT
+#define AUTOPILOT
+
+#include <stdint.h>
+#include "game.h"
+
+#ifdef AUTOPILOT_INTERNAL
+/*
+ * Search buffers, one entry per cell, allocated once for the board size.
+ * 'seen' holds the search that last reached a cell, so nothing is cleared between decisions.
+ */
+typedef struct Autopilot {
+	int width, height;
+	int *free_at;       /* Fewest moves before the head may enter the cell, AUTOPILOT_NEVER for walls */
+	uint32_t *seen;
+	uint32_t search;    /* Number of the current search */
+	int *distance;      /* Moves from the head */
+	uint8_t *parent;    /* Index of the move that reached the cell */
+	int *queue;         /* Breadth first frontier */
+	uint32_t *taken;    /* Cells of the snake at the end of a plan, marked with the search number */
+	int *trail;         /* The body, tail first, followed by the planned path. Twice the cells */
+	int64_t decisions, plans, plan_steps, fallbacks;
+	double seconds;     /* Time spent in autopilot_steer */
+} Autopilot;
+#endif
+
+#ifndef AUTOPILOT_INTERNAL
+typedef void Autopilot;
+#endif
+
+typedef struct AutopilotStats {
+	int64_t decisions;           /* Calls to autopilot_steer */
+	int64_t plans;               /* Decisions that followed a path to the food */
+	int64_t fallbacks;           /* Decisions without a safe path to the food, which stalled instead */
+	double decisions_per_second; /* Over the time spent deciding */
+	double average_plan;         /* Average length of the paths to the food, in moves */
+} AutopilotStats;
+
+/*
+ * Creates a planner for games of size 'width' x 'height'.
+ */
+Autopilot *autopilot_create(int width, int height);
+
+/*
+ * Plans from the current position of 'game', which must have the planner's size and not be
+ * GAME_CHUNKED, and queues the first move with game_set_snake_direction. Call it once per
+ * update, when no turn is queued. The plan is the shortest path to the food where
+ * body cells count as free from the move the tail has left them. The path is only taken if the
+ * snake that eats the food at its end can still reach its tail; otherwise the snake stalls
+ * on a step that keeps its tail reachable, or failing that on the step with the most room. Returns the queued turn or GSD_NONE if the snake keeps its direction.
+ */
+GameSnakeDirection autopilot_steer(Autopilot *autopilot, GameContext *game);
+
+/*
+ * Gets the counters of the decisions taken so far.
+ */
+void autopilot_stats(Autopilot *autopilot, AutopilotStats *stats);
+
+/*
+ * Destroys the planner.
+ */
+void autopilot_destroy(Autopilot *autopilot);
+
+#endif // !AUTOPILOT
@@ -0,0 +1,100 @@
+#ifndef BATCH
+#define BATCH
+
+#include <stdint.h>
+#include "game.h"
+
+#ifdef BATCH_INTERNAL
+
+#include "random.h"
+
+struct GameBatch;
+typedef void (*GameBatchStep)(struct GameBatch *batch, const GameSnakeDirection *actions, float *rewards, unsigned char *dones);
+
+/*
+ * Headless simulation of many games on the same board size. Every field is an array with
+ * one entry per game (or one block of 'cells' entries per game), so stepping the whole
+ * batch walks contiguous memory instead of chasing a GameContext and a Queue per game.
+ */
+typedef struct GameBatch {
+	int count;          /* Number of games */
+	int width, height;  /* Size of the map */
+	int cells;          /* width * height */
+	int row_words;      /* Number of 64 bit words per occupancy row */
+	int ring_bytes;     /* Bytes of one body ring */
+	int start_x, start_y;
+
+	int *snake_x, *snake_y; /* Snake head positions */
+	int *move_x, *move_y;
+	int *food;              /* Food cell (y * width + x) or -1 */
+	int *snake_length;
+	int *tail_x, *tail_y;
+	int *body_front;        /* Ring slot of the direction leaving the tail */
+	int *body_size;         /* Number of segments, one more than the directions in the ring */
+	uint8_t *body;          /* 'ring_bytes' per game: 2 bit direction from every segment to the next one */
+	uint64_t *occupancy;    /* 'height * row_words' words per game */
+	int *free_count;
+	int *free_cells;        /* 'cells' entries per game */
+	int *free_index;        /* 'cells' entries per game */
+	Random *random;
+	int64_t steps;          /* Calls to game_batch_step */
+	int64_t *start_step;    /* Value of 'steps' when the game was last started */
+	int64_t *pushes;        /* Segments pushed since the game was last started, the head last */
+	GameBatchStep step;     /* Kernel picked by game_batch_kernel_set */
+} GameBatch;
+#endif
+
+#ifndef BATCH_INTERNAL
+typedef void GameBatch;
+#endif
+
+typedef enum GameBatchKernel {
+	GBK_AUTO = 0,     /* Fastest kernel supported by the cpu and the board size */
+	GBK_SCALAR,       /* One game at a time */
+	GBK_AVX2,         /* Eight games per instruction stream */
+	GBK_SCALAR_FIXED, /* GBK_SCALAR compiled for the board size, only for the sizes listed in batch.c */
+	GBK_AVX2_FIXED,   /* GBK_AVX2 compiled for the board size, only for the sizes listed in batch.c */
+} GameBatchKernel;
+
+/*
+ * Creates 'count' games of size 'width' x 'height' and starts each of them in the middle of the map.
+ * Game 'i' is seeded with 'seed + i' and plays out exactly like a GameContext created with that seed.
+ */
+GameBatch *game_batch_create(int count, int width, int height, uint64_t seed);
+
+/*
+ * Returns the number of games in the batch.
+ */
+int game_batch_count(GameBatch *batch);
+
+/*
+ * Applies one direction per game and advances every game by one update.
+ * 'rewards' receives 1 for eaten food, -1 for a lost game and 0 otherwise.
+ * 'dones' receives 1 for lost games, which are restarted before the call returns.
+ * 'actions' may contain GSD_NONE to keep the current direction.
+ */
+void game_batch_step(GameBatch *batch, const GameSnakeDirection *actions, float *rewards, unsigned char *dones);
+
+/*
+ * Starts every game again. Observation layouts see the restart and write a full observation.
+ */
+void game_batch_reset(GameBatch *batch);
+
+/*
+ * Writes the observation of every game to 'dst', one game after the other, each laid out
+ * like game_observe. 'layouts' holds one layout per game, all with the same type and padding.
+ */
+void game_batch_observe(GameBatch *batch, GameObserveLayout *layouts, void *dst);
+
+/*
+ * Selects the kernel used by game_batch_step. Returns 1 on success and 0 if the cpu does not support it,
+ * in which case the current kernel is kept. Batches start with GBK_AUTO.
+ */
+int game_batch_kernel_set(GameBatch *batch, GameBatchKernel kernel);
+
+/*
+ * Destroys the batch.
+ */
+void game_batch_destroy(GameBatch *batch);
+
+#endif // !BATCH
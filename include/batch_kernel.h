@@ -0,0 +1,271 @@
+#ifndef BATCH_KERNEL
+#define BATCH_KERNEL
+
+/*
+ * Game rules of GameBatch, written once for any board size. Every function takes the size as
+ * 'width' and 'height' and is always inlined, so a caller passing constants gets bounds checks,
+ * cell indexing and ring wrapping folded at compile time; powers of two turn into shifts and
+ * masks. Only batch.c includes this file, after defining BATCH_INTERNAL.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BATCH_X86
+#endif
+
+#include "batch.h"
+#include "game_rules.h"
+
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+
+KERNEL_INLINE uint64_t *internal_kernel_word(GameBatch *b, int i, int x, int y, const int width, const int height)
+{
+	const unsigned row_words = (width + 63) / 64;
+	return &b->occupancy[((size_t)i * height + y) * row_words + ((unsigned)x >> 6)];
+}
+
+/* Must be called before the head position is updated. */
+KERNEL_INLINE void internal_kernel_push(GameBatch *b, int i, int x, int y, const int width, const int height)
+{
+	const unsigned cells = width * height;
+	const unsigned ring_bytes = (cells + 3) / 4;
+	int cell = y * width + x;
+	if (b->body_size[i] > 0) {
+		int dx = x - b->snake_x[i];
+		int dy = y - b->snake_y[i];
+		unsigned code = internal_body_code(dx, dy);
+		unsigned slot = (unsigned)(b->body_front[i] + b->body_size[i] - 1) % cells;
+		uint8_t *byte = &b->body[(size_t)i * ring_bytes + (slot >> 2)];
+		int shift = (slot & 3) * 2;
+		*byte = (*byte & ~(3 << shift)) | code << shift;
+	} else {
+		b->tail_x[i] = x;
+		b->tail_y[i] = y;
+	}
+	b->body_size[i]++;
+	b->pushes[i]++;
+	*internal_kernel_word(b, i, x, y, width, height) |= (uint64_t)1 << (x & 63);
+	internal_free_remove(&b->free_cells[(size_t)i * cells], &b->free_index[(size_t)i * cells], &b->free_count[i], cell);
+}
+
+KERNEL_INLINE void internal_kernel_pop(GameBatch *b, int i, const int width, const int height)
+{
+	const unsigned cells = width * height;
+	const unsigned ring_bytes = (cells + 3) / 4;
+	unsigned slot = b->body_front[i];
+	unsigned code = (b->body[(size_t)i * ring_bytes + (slot >> 2)] >> ((slot & 3) * 2)) & 3;
+	int x = b->tail_x[i];
+	int y = b->tail_y[i];
+	int cell = y * width + x;
+	b->tail_x[i] += BODY_CODE_X[code];
+	b->tail_y[i] += BODY_CODE_Y[code];
+	b->body_front[i] = (slot + 1) % cells;
+	b->body_size[i]--;
+	*internal_kernel_word(b, i, x, y, width, height) &= ~((uint64_t)1 << (x & 63));
+	internal_free_add(&b->free_cells[(size_t)i * cells], &b->free_index[(size_t)i * cells], &b->free_count[i], cell);
+}
+
+KERNEL_INLINE void internal_kernel_respawn_food(GameBatch *b, int i, const int width, const int height)
+{
+	const unsigned cells = width * height;
+	if (b->free_count[i] == 0) {
+		b->food[i] = -1;
+		return;
+	}
+	b->food[i] = b->free_cells[(size_t)i * cells + random_bounded(&b->random[i], b->free_count[i])];
+}
+
+/* Same as game_start. */
+KERNEL_INLINE void internal_kernel_start(GameBatch *b, int i, const int width, const int height)
+{
+	const int cells = width * height;
+	const int row_words = (width + 63) / 64;
+	b->snake_x[i] = b->start_x;
+	b->snake_y[i] = b->start_y;
+	b->move_x[i] = 0;
+	b->move_y[i] = 0;
+	b->snake_length[i] = 2;
+	b->start_step[i] = b->steps;
+	b->body_front[i] = 0;
+	b->body_size[i] = 0;
+	b->pushes[i] = 0;
+	memset(&b->occupancy[(size_t)i * height * row_words], 0, height * row_words * sizeof(*b->occupancy));
+
+	int *free_cells = &b->free_cells[(size_t)i * cells];
+	int *free_index = &b->free_index[(size_t)i * cells];
+	b->free_count[i] = cells;
+	for (int c = 0; c < cells; ++c) {
+		free_cells[c] = c;
+		free_index[c] = c;
+	}
+
+	internal_kernel_push(b, i, b->start_x, b->start_y, width, height);
+	internal_kernel_respawn_food(b, i, width, height);
+}
+
+/* Moves the head of a game that neither died nor stands still. Returns the reward of the step. */
+KERNEL_INLINE float internal_kernel_advance(GameBatch *b, int i, int new_x, int new_y, int ate, const int width, const int height)
+{
+	if (ate) {
+		b->snake_length[i]++;
+	}
+
+	if (b->body_size[i] >= b->snake_length[i]) {
+		internal_kernel_pop(b, i, width, height);
+	}
+
+	internal_kernel_push(b, i, new_x, new_y, width, height);
+	b->snake_x[i] = new_x;
+	b->snake_y[i] = new_y;
+
+	if (ate) {
+		internal_kernel_respawn_food(b, i, width, height);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Same as game_update. Returns the reward of the step. */
+KERNEL_INLINE float internal_kernel_update(GameBatch *b, int i, unsigned char *done, const int width, const int height)
+{
+	*done = 0;
+	if (b->move_x[i] + b->move_y[i] == 0) return 0;
+
+	int new_x = b->snake_x[i] + b->move_x[i];
+	int new_y = b->snake_y[i] + b->move_y[i];
+
+	if ((unsigned)new_x >= (unsigned)width || (unsigned)new_y >= (unsigned)height ||
+		(*internal_kernel_word(b, i, new_x, new_y, width, height) >> (new_x & 63)) & 1) {
+		*done = 1;
+		internal_kernel_start(b, i, width, height);
+		return -1;
+	}
+
+	return internal_kernel_advance(b, i, new_x, new_y, new_y * width + new_x == b->food[i], width, height);
+}
+
+KERNEL_INLINE void internal_kernel_step_scalar(GameBatch *b, const GameSnakeDirection *actions, float *rewards, unsigned char *dones,
+	const int width, const int height)
+{
+	for (int i = 0; i < b->count; ++i) {
+		internal_direction_apply(&b->move_x[i], &b->move_y[i], actions[i]);
+		rewards[i] = internal_kernel_update(b, i, &dones[i], width, height);
+	}
+}
+
+#ifdef BATCH_X86
+/*
+ * Steps eight games at once. Direction changes, bounds, self collisions and food hits are
+ * computed for all lanes with masks; only the ring buffer and free set bookkeeping of games
+ * that actually moved runs per game.
+ */
+__attribute__((target("avx2")))
+KERNEL_INLINE void internal_kernel_step_avx2(GameBatch *b, const GameSnakeDirection *actions, float *rewards, unsigned char *dones,
+	const int width_, const int height_)
+{
+	/* Indexed by GameSnakeDirection. */
+	const __m256i table_x = _mm256_setr_epi32(0, 0, 0, 1, -1, 0, 0, 0);
+	const __m256i table_y = _mm256_setr_epi32(0, -1, 1, 0, 0, 0, 0, 0);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i width = _mm256_set1_epi32(width_);
+	const __m256i height = _mm256_set1_epi32(height_);
+	const __m256i row_halves = _mm256_set1_epi32(2 * ((width_ + 63) / 64));
+	const __m256i lane_offsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const int *occupancy = (const int *)b->occupancy;
+
+	int i = 0;
+	for (; i + 8 <= b->count; i += 8) {
+		__m256i action = _mm256_loadu_si256((const __m256i *)&actions[i]);
+		__m256i move_x = _mm256_loadu_si256((const __m256i *)&b->move_x[i]);
+		__m256i move_y = _mm256_loadu_si256((const __m256i *)&b->move_y[i]);
+		__m256i want_x = _mm256_permutevar8x32_epi32(table_x, action);
+		__m256i want_y = _mm256_permutevar8x32_epi32(table_y, action);
+
+		/* A turn is refused if it is along the axis the snake already moves on. */
+		__m256i turn_x = _mm256_andnot_si256(_mm256_cmpeq_epi32(want_x, zero), _mm256_cmpeq_epi32(move_x, zero));
+		__m256i turn_y = _mm256_andnot_si256(_mm256_cmpeq_epi32(want_y, zero), _mm256_cmpeq_epi32(move_y, zero));
+		__m256i turn = _mm256_or_si256(turn_x, turn_y);
+		move_x = _mm256_blendv_epi8(move_x, want_x, turn);
+		move_y = _mm256_blendv_epi8(move_y, want_y, turn);
+		_mm256_storeu_si256((__m256i *)&b->move_x[i], move_x);
+		_mm256_storeu_si256((__m256i *)&b->move_y[i], move_y);
+
+		__m256i moving = _mm256_xor_si256(_mm256_cmpeq_epi32(_mm256_add_epi32(move_x, move_y), zero), _mm256_set1_epi32(-1));
+		__m256i new_x = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)&b->snake_x[i]), move_x);
+		__m256i new_y = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)&b->snake_y[i]), move_y);
+
+		__m256i outside = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpgt_epi32(zero, new_x), _mm256_cmpgt_epi32(new_x, _mm256_sub_epi32(width, one))),
+			_mm256_or_si256(_mm256_cmpgt_epi32(zero, new_y), _mm256_cmpgt_epi32(new_y, _mm256_sub_epi32(height, one))));
+		__m256i inside = _mm256_andnot_si256(outside, moving);
+
+		/* Occupancy is read as 32 bit halves of the 64 bit words; lanes outside the map are not loaded. */
+		__m256i row = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_add_epi32(lane_offsets, _mm256_set1_epi32(i)), height), new_y);
+		__m256i index = _mm256_add_epi32(_mm256_mullo_epi32(row, row_halves), _mm256_srli_epi32(new_x, 5));
+		__m256i words = _mm256_mask_i32gather_epi32(zero, occupancy, index, inside, 4);
+		__m256i bits = _mm256_and_si256(_mm256_srlv_epi32(words, _mm256_and_si256(new_x, _mm256_set1_epi32(31))), one);
+		__m256i hit = _mm256_cmpeq_epi32(bits, one);
+
+		__m256i cell = _mm256_add_epi32(_mm256_mullo_epi32(new_y, width), new_x);
+		__m256i food = _mm256_cmpeq_epi32(cell, _mm256_loadu_si256((const __m256i *)&b->food[i]));
+
+		int moving_mask = _mm256_movemask_ps(_mm256_castsi256_ps(moving));
+		int dead_mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(moving, _mm256_or_si256(outside, hit))));
+		int food_mask = _mm256_movemask_ps(_mm256_castsi256_ps(food));
+
+		int xs[8], ys[8];
+		_mm256_storeu_si256((__m256i *)xs, new_x);
+		_mm256_storeu_si256((__m256i *)ys, new_y);
+
+		for (int lane = 0; lane < 8; ++lane) {
+			int game = i + lane;
+			dones[game] = 0;
+			rewards[game] = 0;
+			if (!((moving_mask >> lane) & 1)) continue;
+			if ((dead_mask >> lane) & 1) {
+				dones[game] = 1;
+				rewards[game] = -1;
+				internal_kernel_start(b, game, width_, height_);
+				continue;
+			}
+			rewards[game] = internal_kernel_advance(b, game, xs[lane], ys[lane], (food_mask >> lane) & 1, width_, height_);
+		}
+	}
+
+	for (; i < b->count; ++i) {
+		internal_direction_apply(&b->move_x[i], &b->move_y[i], actions[i]);
+		rewards[i] = internal_kernel_update(b, i, &dones[i], width_, height_);
+	}
+}
+#endif
+
+/*
+ * Defines the step functions of a 'W' x 'H' board, named internal_batch_step_scalar_WxH and,
+ * on x86, internal_batch_step_avx2_WxH.
+ */
+#define BATCH_KERNEL_SCALAR(W, H) \
+	void internal_batch_step_scalar_##W##x##H(GameBatch *b, const GameSnakeDirection *actions, float *rewards, unsigned char *dones) \
+	{ \
+		internal_kernel_step_scalar(b, actions, rewards, dones, W, H); \
+	}
+
+#ifdef BATCH_X86
+#define BATCH_KERNEL_SPECIALIZE(W, H) \
+	BATCH_KERNEL_SCALAR(W, H) \
+	__attribute__((target("avx2"))) \
+	void internal_batch_step_avx2_##W##x##H(GameBatch *b, const GameSnakeDirection *actions, float *rewards, unsigned char *dones) \
+	{ \
+		internal_kernel_step_avx2(b, actions, rewards, dones, W, H); \
+	}
+#define BATCH_KERNEL_ENTRY(W, H) { W, H, internal_batch_step_scalar_##W##x##H, internal_batch_step_avx2_##W##x##H }
+#else
+#define BATCH_KERNEL_SPECIALIZE(W, H) BATCH_KERNEL_SCALAR(W, H)
+#define BATCH_KERNEL_ENTRY(W, H) { W, H, internal_batch_step_scalar_##W##x##H, NULL }
+#endif
+
+#endif // !BATCH_KERNEL
@@ -0,0 +1,80 @@
+#ifndef BITBOARD
+#define BITBOARD
+
+#include <stdint.h>
+#include "game.h"
+#include "level.h"
+#include "random.h"
+
+#define BITBOARD_SIDE 16 /* Largest width and height */
+
+/*
+ * One bit per cell of a 16x16 board: cell y * 16 + x is bit x + 16 * (y & 3) of word y >> 2.
+ */
+typedef struct Bitboard {
+	uint64_t words[4];
+} Bitboard;
+
+/*
+ * Alternative game core for boards up to 16x16. The whole position is a few bitboards and
+ * a ring of body cells ordered by age, so a game is a small value that can be copied for
+ * lookahead and never allocates. The rules are those of game_update, except that new food is
+ * drawn from the free cells in cell order rather than in free set order, so food lands
+ * elsewhere than in a GameContext created with the same seed.
+ */
+typedef struct BitboardGame {
+	Bitboard body;       /* Snake cells, the head included */
+	Bitboard blocked;    /* Walls and cells outside the map */
+	int width, height;
+	int started;
+	int head;            /* Head cell (y * 16 + x) */
+	int food;            /* Food cell or -1 */
+	int move_x, move_y;
+	int snake_length;
+	int body_size;       /* Cells in the ring */
+	uint8_t front;       /* Ring slot of the tail, wraps with the ring */
+	uint8_t ring[256];   /* Body cells, tail first. Segment i from the tail leaves after i + 1 pops */
+	int64_t ticks;       /* Calls to bitboard_update since the game was initialized */
+	int64_t start_tick;  /* Value of 'ticks' at the last bitboard_start */
+	Random random;       /* Food placement */
+} BitboardGame;
+
+/*
+ * Sets up an empty 'width' x 'height' board. Both sides must be at most BITBOARD_SIDE.
+ */
+void bitboard_init(BitboardGame *game, int width, int height, uint64_t seed);
+
+/*
+ * Sets up the board of 'level', which must be at most BITBOARD_SIDE on each side.
+ * The walls are copied, so the level may be closed afterwards.
+ */
+void bitboard_init_level(BitboardGame *game, const Level *level, uint64_t seed);
+
+/*
+ * Starts the snake at (x, y) like game_start. A running game is simply started over.
+ */
+void bitboard_start(BitboardGame *game, int snake_x, int snake_y);
+
+/*
+ * Turns to 'direction', unless it is GSD_NONE or along the current axis, and moves the snake.
+ * Returns 1 if the game is lost.
+ */
+int bitboard_update(BitboardGame *game, GameSnakeDirection direction);
+
+/*
+ * Returns 1 if (x, y) is outside the map, a wall or part of the snake.
+ */
+int bitboard_is_blocked(const BitboardGame *game, int x, int y);
+
+/*
+ * Fills 'region' with the cells reachable from (x, y) through free cells, (x, y) included
+ * even if it is blocked, and returns their number. 'region' may be NULL.
+ */
+int bitboard_reachable(const BitboardGame *game, int x, int y, Bitboard *region);
+
+/*
+ * Returns the number of cells set in 'board'.
+ */
+int bitboard_count(const Bitboard *board);
+
+#endif // !BITBOARD
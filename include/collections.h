@@ -1,7 +1,12 @@
 #ifndef COLLECTIONS
 #define COLLECTIONS
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef COLLECTIONS_INTERNAL
+#include <stdatomic.h>
+
 typedef struct Queue {
 	int front, rear, size;
 	int capacity;
@@ -9,10 +14,42 @@ typedef struct Queue {
 	void *callback_context;
 	char memory[];
 } Queue;
+
+/* The check word holds 'key ^ value', so a torn write never passes as a hit. Both words 0 is an empty entry. */
+typedef struct TableEntry {
+	_Atomic uint64_t check;
+	_Atomic uint64_t value;
+} TableEntry;
+
+typedef struct Table {
+	uint64_t mask; /* Capacity - 1, capacity is a power of two */
+	_Atomic uint64_t evictions; /* Stores into a full bucket, picks the entry the next one overwrites */
+	TableEntry entries[];
+} Table;
+
+typedef struct BitRing {
+	int front, size;
+	int capacity;
+	uint8_t codes[]; /* Four 2 bit codes per byte, lowest bits first */
+} BitRing;
+
+typedef struct MapEntry {
+	uint64_t key;
+	void *value; /* NULL if the slot is empty */
+} MapEntry;
+
+typedef struct Map {
+	uint64_t mask; /* Capacity - 1, capacity is a power of two */
+	int count;
+	MapEntry *entries;
+} Map;
 #endif
 
 #ifndef COLLECTIONS_INTERNAL
 typedef void Queue;
+typedef void Table;
+typedef void BitRing;
+typedef void Map;
 #endif
 
 /*
@@ -22,6 +59,17 @@ typedef void Queue;
  */
 Queue *collections_queue_create(int capacity, int element_size);
 
+/*
+ * Returns the bytes taken by a queue of 'capacity' elements, for placing it with collections_queue_init.
+ */
+size_t collections_queue_bytes(int capacity, int element_size);
+
+/*
+ * Creates a queue inside 'memory', which must hold collections_queue_bytes bytes.
+ * The memory stays the caller's: such a queue is never grown or destroyed.
+ */
+Queue *collections_queue_init(void *memory, int capacity, int element_size);
+
 /*
  * Adds a new element to the queue.
  * The element should be of size 'element_size' that was specified when the queue was created.
@@ -50,11 +98,32 @@ void collections_queue_foreach(Queue *q, void func(void *arg, void *context));
  */
 void collections_queue_peek_last(Queue *q, void *peek);
 
+/*
+ * Gets the value of the first (least recent) element in a queue.
+ */
+void collections_queue_peek_first(Queue *q, void *peek);
+
 /*
  * Removes the least recent element in a queue.
  */
 void collections_queue_pop_first(Queue *q);
 
+/*
+ * Copies all the elements, from the least to the most recent one, to 'destination'.
+ * 'destination' must have room for 'size * element_size' bytes.
+ */
+void collections_queue_copy_out(Queue *q, void *destination);
+
+/*
+ * Replaces the contents of a queue with 'count' elements read from 'source', least recent first.
+ */
+void collections_queue_copy_in(Queue *q, const void *source, int count);
+
+/*
+ * Returns a queue with twice the capacity and the same elements. 'q' is destroyed.
+ */
+Queue *collections_queue_grow(Queue *q);
+
 /*
  * Removes all the elements in a queue.
  */
@@ -65,4 +134,134 @@ void collections_queue_empty(Queue *q);
  */
 void collections_queue_destroy(Queue *q);
 
+/*
+ * Creates a ring buffer of up to 'capacity' 2 bit codes.
+ */
+BitRing *collections_bitring_create(int capacity);
+
+/*
+ * Returns the bytes taken by a ring of 'capacity' codes, for placing it with collections_bitring_init.
+ */
+size_t collections_bitring_bytes(int capacity);
+
+/*
+ * Creates a ring inside 'memory', which must hold collections_bitring_bytes bytes.
+ * The memory stays the caller's: such a ring is never grown or destroyed.
+ */
+BitRing *collections_bitring_init(void *memory, int capacity);
+
+/*
+ * Adds a code (0 to 3) after the most recent one.
+ */
+void collections_bitring_add(BitRing *r, unsigned code);
+
+/*
+ * Returns the 'index'-th code, counting from the least recent one.
+ */
+unsigned collections_bitring_get(BitRing *r, int index);
+
+/*
+ * Removes the least recent code.
+ */
+void collections_bitring_pop_first(BitRing *r);
+
+/*
+ * Return the number of codes stored in the ring.
+ */
+int collections_bitring_size(BitRing *r);
+
+/*
+ * Packs all the codes, least recent first, into '(size + 3) / 4' bytes at 'destination'.
+ */
+void collections_bitring_copy_out(BitRing *r, uint8_t *destination);
+
+/*
+ * Replaces the contents of a ring with 'count' codes packed like collections_bitring_copy_out does.
+ */
+void collections_bitring_copy_in(BitRing *r, const uint8_t *source, int count);
+
+/*
+ * Returns a ring with twice the capacity and the same codes. 'r' is destroyed.
+ */
+BitRing *collections_bitring_grow(BitRing *r);
+
+/*
+ * Removes all the codes in a ring.
+ */
+void collections_bitring_empty(BitRing *r);
+
+/*
+ * Destroys the ring.
+ */
+void collections_bitring_destroy(BitRing *r);
+
+/*
+ * Creates a hash map from 64 bit keys to non NULL pointers. It grows as needed.
+ */
+Map *collections_map_create(int capacity);
+
+/*
+ * Returns the value stored under 'key' or NULL.
+ */
+void *collections_map_get(Map *m, uint64_t key);
+
+/*
+ * Stores 'value' under 'key', replacing the previous value.
+ */
+void collections_map_put(Map *m, uint64_t key, void *value);
+
+/*
+ * Removes 'key' and returns its value, or NULL if it was absent.
+ */
+void *collections_map_remove(Map *m, uint64_t key);
+
+/*
+ * Return the number of keys stored in the map.
+ */
+int collections_map_size(Map *m);
+
+/*
+ * Calls 'func' for each value in a map, in no particular order. The map must not change meanwhile.
+ */
+void collections_map_foreach(Map *m, void func(void *value, void *context), void *context);
+
+/*
+ * Removes all the keys in a map. Values are not freed.
+ */
+void collections_map_empty(Map *m);
+
+/*
+ * Destroys the map. Values are not freed.
+ */
+void collections_map_destroy(Map *m);
+
+/*
+ * Creates a transposition table mapping 64 bit keys (such as game_hash) to 64 bit values.
+ * 'capacity' is rounded up to a power of two. The table is lossy: a full bucket overwrites one of its
+ * entries, each in turn. Key 0 is reserved, it marks empty entries: it is never stored nor found.
+ * collections_table_store and collections_table_probe may be called from several threads at once
+ * without locking. Creating, clearing and destroying the table must not overlap any other call.
+ */
+Table *collections_table_create(int capacity);
+
+/*
+ * Stores 'value' under 'key', which must not be 0.
+ */
+void collections_table_store(Table *t, uint64_t key, uint64_t value);
+
+/*
+ * Looks 'key' up. Returns 1 and writes 'value' if found, 0 otherwise.
+ */
+int collections_table_probe(Table *t, uint64_t key, uint64_t *value);
+
+/*
+ * Removes all the entries of a table. Must not run concurrently with other table functions.
+ */
+void collections_table_clear(Table *t);
+
+/*
+ * Destroys the table.
+ */
+void collections_table_destroy(Table *t);
+
 #endif
@@ -1,40 +1,174 @@
 #ifndef GAME
 #define GAME
 
+#include <stddef.h>
+#include <stdint.h>
+#include "level.h"
+
+typedef enum GameSnakeDirection {
+	GSD_NONE = 0,
+	GSD_DOWN,
+	GSD_UP,
+	GSD_RIGHT,
+	GSD_LEFT,
+} GameSnakeDirection;
+
 #ifdef GAME_INTERNAL
 
 #include "collections.h"
+#include "random.h"
+
+#define GAME_COMMAND_CAPACITY 4 /* Turns that can wait for the next updates */
 
 typedef struct GameContext {
 	int started;
+	int flags;           /* GameFlags */
+	int64_t ticks;       /* Calls to game_update since the game was created */
 	int move_x, move_y;
+	int queued_move_x, queued_move_y; /* Direction once every queued turn is applied */
+	GameSnakeDirection commands[GAME_COMMAND_CAPACITY]; /* Turns applied one per game_update */
+	int command_front, command_count;
+	int command_max_depth, command_drops;
 	int width, height; /* Size of the map */
 	int snake_x, snake_y; /* Snake head position */
 	int food_x, food_y; /* Food position */
 	int snake_length;
-	Queue *positions_queue;
+	int body_size;       /* Number of segments stored in the body */
+	int64_t pushes;      /* Segments pushed since game_start, the head last */
+	Queue *positions_queue; /* Body as (x, y) pairs, NULL with GAME_COMPACT_BODY */
+	BitRing *body_codes; /* Compact body: direction from every segment to the next one, tail first */
+	int tail_x, tail_y;  /* Compact body: tail position */
+	void *callback_context;
+	int body_capacity;   /* Segments (or compact codes) the body can hold before it has to grow */
+	int row_words;       /* Number of 64 bit words per occupancy row */
+	uint64_t *occupancy; /* One bit per cell, set if a snake segment or a wall is there. NULL with GAME_CHUNKED */
+	uint64_t *reach;     /* game_reachable scratch: the reached cells, then the open ones, both in occupancy layout. NULL with GAME_CHUNKED */
+	const Level *level;  /* Shared walls, NULL on an empty map */
+	Map *chunks;         /* Chunked world: occupancy of 64x64 cell chunks, allocated while the snake is inside */
+	uint64_t chunk_key;  /* Last chunk looked up */
+	struct GameChunk *chunk;
+	int free_count;      /* Number of cells not covered by the snake. Not kept with GAME_CHUNKED */
+	int free_total;      /* Number of cells that are not walls, free_count with no snake */
+	int *free_cells;     /* Free set of the cell keys, see game_rules.h */
+	int *free_index;     /* Slot of the free keys that sit in a hole of free_cells */
+	const int *open_cells; /* Level: cell of every key. NULL on an empty map, where keys are the cells (y * width + x) */
+	const int *open_index; /* Level: key of every cell, -1 on walls */
+	int64_t start_tick;  /* Value of 'ticks' at the last game_start */
+	Random random;       /* Food placement */
+	uint64_t hash;       /* Zobrist hash of body, head, food and direction */
+	struct GamePool *pool; /* Pool the game is acquired from, NULL if it was created */
 } GameContext;
+
+/*
+ * Dense games are one block: the context followed by the body, occupancy and free set.
+ * A pool carves blocks out of slabs, lays them out once and keeps released ones on a free list.
+ */
+typedef struct GamePoolBlock {
+	struct GamePoolBlock *next;
+} GamePoolBlock;
+
+typedef struct GamePool {
+	int width, height, flags;
+	size_t stride;       /* Bytes of one game block */
+	int slab_games;      /* Games per slab */
+	char **slabs;
+	int slab_count, slab_capacity;
+	GamePoolBlock *free; /* Blocks of released games */
+} GamePool;
 #endif
 
 #ifndef GAME_INTERNAL
 typedef void GameContext;
+typedef void GamePool;
 #endif // !GAME_INTERNAL
 
-typedef enum GameSnakeDirection {
-	GSD_NONE = 0,
-	GSD_DOWN,
-	GSD_UP,
-	GSD_RIGHT,
-	GSD_LEFT,
-} GameSnakeDirection;
+typedef struct GameInputStats {
+	int depth;     /* Turns waiting right now */
+	int max_depth; /* Most turns that were waiting at once */
+	int drops;     /* Turns lost because the queue was full */
+} GameInputStats;
 
-GameContext *game_create(int width, int height);
+/*
+ * What one game_update_ex changed. Fields of an event that did not happen are 0.
+ */
+typedef struct GameDelta {
+	int moved;                    /* The head advanced to (head_x, head_y) */
+	int head_x, head_y;
+	int tail_removed;             /* The tail segment at (tail_x, tail_y) was removed */
+	int tail_x, tail_y;
+	int food_moved;               /* The food was eaten at 'from' and respawned at 'to', -1 -1 if the map is full */
+	int food_from_x, food_from_y;
+	int food_to_x, food_to_y;
+	int died;                     /* The update lost the game, nothing else changed */
+} GameDelta;
+
+typedef enum GameFlags {
+	GAME_COMPACT_BODY = 1 << 0, /* Store the body as 2 bit directions instead of 8 byte positions */
+	GAME_CHUNKED      = 1 << 1, /* Memory follows the snake length instead of the map size, for huge maps */
+} GameFlags;
+
+typedef enum GameObserveType {
+	GAME_OBSERVE_U8 = 0, /* uint8_t cells */
+	GAME_OBSERVE_F32,    /* float cells */
+} GameObserveType;
+
+/* Planes of an observation, each (height + 2 * padding) rows of (width + 2 * padding) cells. */
+typedef enum GameObservePlane {
+	GAME_PLANE_HEAD = 0, /* 1 on the head */
+	GAME_PLANE_BODY,     /* Push number of every segment since game_start, see below */
+	GAME_PLANE_FOOD,     /* 1 on the food */
+	GAME_PLANE_WALL,     /* 1 on the padding around the board and on level walls */
+	GAME_PLANES,
+} GameObservePlane;
+
+/*
+ * Shape of an observation and what the buffer already holds. Zero the whole struct, then set
+ * 'type' and 'padding' before the first call. Zero 'written' whenever the buffer is changed by
+ * something else or the game is restored from a snapshot. Successive ticks of one game then only
+ * write the cells that changed, and give the same bytes as a full write.
+ * GAME_PLANE_BODY holds 1 + (n - 1) % P on the segment pushed n-th since game_start, with P 255
+ * for GAME_OBSERVE_U8 and 2^24 for GAME_OBSERVE_F32. Every segment is one more than the one
+ * behind it, modulo P, so the age of a segment is the head's value minus its own, modulo P.
+ * Bodies of P segments or more repeat values.
+ */
+typedef struct GameObserveLayout {
+	GameObserveType type;
+	int padding;         /* Wall cells around the board on every side */
+	int written;         /* Set once the buffer holds an observation, the fields below describe it */
+	int head, food, tail, body_size;
+	int64_t tick, start_tick;
+} GameObserveLayout;
+
+GameContext *game_create(int width, int height, uint64_t seed); /* Games created with the same seed and given the same input play out identically. */
+GameContext *game_create_ex(int width, int height, uint64_t seed, int flags); /* Same as game_create, with GameFlags. */
+GameContext *game_create_level(const Level *level, uint64_t seed, int flags); /* Game on the map of 'level', which must outlive it. Not available with GAME_CHUNKED. */
 void         game_start(GameContext *game, int snake_x, int snake_y);
 int          game_update(GameContext *game); /* Updates the game. Returns 1 if the game is lost. */
+int          game_update_ex(GameContext *game, GameDelta *delta); /* Same as game_update, and describes the changes in 'delta' if it isn't NULL. */
+int          game_advance(GameContext *game, int64_t max_ticks); /* Same as up to 'max_ticks' game_update calls, stopping at a loss. Straight stretches skip the per tick checks. */
 void         game_get_food(GameContext *game, int *position); /* Gets the position of a snake. */
+void         game_get_head(GameContext *game, int *position); /* Gets the position of the snake's head. */
+void         game_get_move(GameContext *game, int *move); /* Gets the step the snake takes once every queued turn is applied, (0, 0) before the first turn. */
+int          game_is_blocked(GameContext *game, int x, int y); /* Returns 1 if (x, y) is outside the map, a wall or part of the snake. */
+int          game_reachable(GameContext *game, int x, int y, int *tail_reachable); /* Counts the free cells reachable from (x, y), which counts itself even if occupied. 'tail_reachable' receives 1 if the tail borders them. Not available with GAME_CHUNKED. */
 void         game_callback_context_set(GameContext *game, void *context); /* Sets the callback context. */
 void         game_snake_foreach(GameContext *game, void func(void *context, void *arg)); /* Does something for each snake tile (renders probably) */
-int          game_set_snake_direction(GameContext *game, GameSnakeDirection direction); /* Changes a direction. Returns 1 if direction changed successfully. */
-void         game_destroy(GameContext *game);
+void         game_body_foreach(GameContext *game, void func(void *xy, void *context), void *context); /* Calls 'func' with every (x, y) of the body, tail first, and 'context' instead of the callback context. */
+int          game_set_snake_direction(GameContext *game, GameSnakeDirection direction); /* Queues a turn for the next free update. Returns 1 if it was accepted. */
+void         game_input_stats(GameContext *game, GameInputStats *stats); /* Gets the turn queue counters. */
+int          game_snake_length(GameContext *game); /* Length the snake has or is growing to. Starts at 2, one more per food. */
+int64_t      game_ticks(GameContext *game); /* Number of game_update calls since the game was created. Replays are stamped with it. */
+size_t       game_observe_size(GameContext *game, const GameObserveLayout *layout); /* Bytes of one observation, GAME_PLANES x rows x columns. */
+void         game_observe(GameContext *game, GameObserveLayout *layout, void *dst); /* Writes the observation planes to 'dst'. Not available with GAME_CHUNKED. */
+uint64_t     game_hash(GameContext *game); /* Zobrist hash of the position, kept up to date by every change. */
+size_t       game_snapshot_size(GameContext *game); /* Bytes needed to snapshot the current state. Grows with the snake. */
+void         game_snapshot_save(GameContext *game, void *buffer); /* Writes the whole state, including the generator, to 'buffer'. */
+void         game_snapshot_restore(GameContext *game, const void *buffer); /* Loads a snapshot taken from a game of the same size. Does not allocate unless GAME_CHUNKED. */
+void         game_destroy(GameContext *game); /* Pooled games go back to their pool. */
+
+GamePool    *game_pool_create(int width, int height, int flags, int slab_games); /* Pool of games of one size and GameFlags, allocated 'slab_games' at a time. Not available with GAME_CHUNKED. */
+GameContext *game_pool_acquire(GamePool *pool, uint64_t seed); /* Same as game_create_ex with the pool's size and flags once game_start is called, which clears the body a released game kept. Only allocates, and lays out a slab of games, when every game is out. */
+void         game_pool_release(GamePool *pool, GameContext *game); /* Hands a game back. Restarting a game with game_start needs no release. */
+void         game_pool_destroy(GamePool *pool); /* Frees the pool, with every game still acquired from it. */
 
 #endif // Game
@@ -0,0 +1,96 @@
+#ifndef GAME_RULES
+#define GAME_RULES
+
+/*
+ * Rules shared by every simulator in the tree: game.c, the batch kernels, arena.c and
+ * bitboard.c. They are small and static inline so the batch kernels can fold them into their
+ * loops. Not part of the public API.
+ */
+
+#include <stdlib.h>
+#include "game.h"
+
+/* Compact body codes, indexed by code: the step from a segment to the next one. */
+static const int BODY_CODE_X[4] = { 1, -1, 0,  0 };
+static const int BODY_CODE_Y[4] = { 0,  0, 1, -1 };
+
+/* Returns the compact body code of a step to a neighbour cell. */
+static inline unsigned internal_body_code(int dx, int dy)
+{
+	return dx ? (dx < 0) : 2 + (dy < 0);
+}
+
+/* Turns a move vector into 'direction'. Returns 0 and leaves it alone if the turn is along the current axis. */
+static inline int internal_direction_apply(int *move_x, int *move_y, GameSnakeDirection direction)
+{
+	switch (direction) {
+		case GSD_UP:
+			if (abs(*move_y) == 1) return 0;
+			*move_x = 0;
+			*move_y = 1;
+			return 1;
+		case GSD_DOWN:
+			if (abs(*move_y) == 1) return 0;
+			*move_x = 0;
+			*move_y = -1;
+			return 1;
+		case GSD_RIGHT:
+			if (abs(*move_x) == 1) return 0;
+			*move_x = 1;
+			*move_y = 0;
+			return 1;
+		case GSD_LEFT:
+			if (abs(*move_x) == 1) return 0;
+			*move_x = -1;
+			*move_y = 0;
+			return 1;
+		case GSD_NONE:
+			return 0;
+	}
+	return 0;
+}
+
+/*
+ * Free set over the keys 0 .. total - 1, with 'n' = '*free_count' keys free. The first n slots of
+ * 'free_cells' hold the free keys and the layout depends on little history:
+ *   - a free key k < n sits in its own slot k,
+ *   - every slot from n on holds its own key,
+ *   - the slot of a taken key k < n, a hole, holds one of the free keys from n on, whose slot
+ *     'free_index' gives. Only those entries of 'free_index' are kept.
+ * Taking the keys of a body and putting them back therefore only touches the holes, which are
+ * the body keys below n: writing k into every one of them empties the set again, and a snapshot
+ * only has to remember what the holes hold.
+ */
+
+/* Takes a free key out of the set. */
+static inline void internal_free_remove(int *free_cells, int *free_index, int *free_count, int key)
+{
+	int slot = key < *free_count ? key : free_index[key];
+	int last = free_cells[--*free_count];
+	free_cells[slot] = last;
+	free_index[last] = slot;
+	free_cells[*free_count] = *free_count;
+}
+
+/* Puts a taken key back into the set. Key n moves to its own slot, so whatever held it or its hole needs a new one. */
+static inline void internal_free_add(int *free_cells, int *free_index, int *free_count, int key)
+{
+	int n = *free_count;
+	int hole = free_index[n];
+	int n_in_hole = (unsigned)hole < (unsigned)n && free_cells[hole] == n;
+	int moved = -1;
+	if (key < n) {
+		moved = free_cells[key];
+		free_cells[key] = key;
+	} else if (key > n) {
+		moved = key;
+	}
+	if (moved >= 0 && moved != n) {
+		int slot = n_in_hole ? hole : n;
+		free_cells[slot] = moved;
+		free_index[moved] = slot;
+	}
+	*free_count = n + 1;
+}
+
+#endif // !GAME_RULES
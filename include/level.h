@@ -0,0 +1,102 @@
+#ifndef LEVEL
+#define LEVEL
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Level file layout, little endian, read in place through mmap:
+ *   LevelHeader
+ *   Wall bitmap: height rows of row_words 64 bit words, bit x & 63 of word x >> 6 set for a wall.
+ *                This is the occupancy layout of GameContext, so games copy rows as they are.
+ *                Bits past the width must be 0.
+ *   Distance field (LEVEL_DISTANCE): width * height uint16_t, row by row. Steps to the nearest
+ *                wall or the outside of the map, 0 on walls.
+ */
+
+#define LEVEL_MAGIC   "SNKL"
+#define LEVEL_VERSION 1
+
+typedef enum LevelFlags {
+	LEVEL_DISTANCE = 1 << 0, /* A distance field follows the walls */
+} LevelFlags;
+
+typedef struct LevelHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t width, height;
+	uint32_t start_x, start_y;
+	uint32_t row_words;
+	uint32_t flags;      /* LevelFlags */
+	uint32_t wall_count;
+	uint32_t reserved;
+} LevelHeader;
+
+#ifdef LEVEL_INTERNAL
+#include <stdatomic.h>
+
+typedef struct Level {
+	void *map;                 /* Whole file, mapped read only */
+	size_t map_size;
+	const LevelHeader *header;
+	const uint64_t *walls;
+	const uint16_t *distance;  /* NULL without LEVEL_DISTANCE */
+	_Atomic(int *) open;       /* Cells that are not walls, row by row, then the index of every cell in them (-1 on walls). Built by the first game on the level */
+} Level;
+#endif
+
+#ifndef LEVEL_INTERNAL
+typedef void Level;
+#endif // !LEVEL_INTERNAL
+
+/*
+ * Maps a level file read only. Returns NULL and prints the reason if the file is missing or malformed.
+ * Any number of games can share one level, which must outlive them. Only the header and the wall
+ * bitmap are checked, nothing is allocated but the Level itself.
+ */
+Level *level_open(const char *path);
+
+/*
+ * Writes a level. 'walls' holds width * height bytes, row by row, non zero for a wall.
+ * The distance field is computed and stored if 'distance' is non zero. Returns 0 on success.
+ */
+int level_write(const char *path, int width, int height, int start_x, int start_y, const unsigned char *walls, int distance);
+
+int level_width(const Level *level);
+int level_height(const Level *level);
+void level_start(const Level *level, int *position); /* Gets the start position of the snake. */
+int level_wall_count(const Level *level);
+
+/*
+ * Returns the wall bitmap, laid out like GameContext occupancy.
+ */
+const uint64_t *level_walls(const Level *level);
+
+/*
+ * Returns the width * height - level_wall_count cells (y * width + x) that are not walls, row by row.
+ * Games number their free set by it, so walls never take part. The first call, usually from
+ * game_create_level, builds the table and the one of level_open_index. It may race other threads.
+ */
+const int *level_open_cells(const Level *level);
+
+/*
+ * Returns the index of every cell in level_open_cells, -1 for walls.
+ */
+const int *level_open_index(const Level *level);
+
+/*
+ * Returns 1 if (x, y) is a wall. Cells outside the map count as walls.
+ */
+int level_is_wall(const Level *level, int x, int y);
+
+/*
+ * Returns the distance of (x, y) to the nearest wall or the outside, or -1 without a distance field.
+ */
+int level_distance(const Level *level, int x, int y);
+
+/*
+ * Unmaps the level.
+ */
+void level_close(Level *level);
+
+#endif // !LEVEL
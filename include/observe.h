@@ -0,0 +1,37 @@
+#ifndef OBSERVE
+#define OBSERVE
+
+#include <stddef.h>
+#include <stdint.h>
+#include "game.h"
+
+/*
+ * Shared writer behind game_observe and game_batch_observe. A frame describes one game
+ * without tying the writer to GameContext or GameBatch.
+ */
+typedef struct ObserveFrame {
+	int width, height;
+	int head;            /* Head cell (y * width + x) */
+	int food;            /* Food cell or -1 */
+	int tail;            /* Tail cell, -1 without a body */
+	int body_size;       /* Segments, the head included */
+	int64_t pushes;      /* Segments pushed since the game was last started, the head last */
+	int64_t tick;        /* Updates since creation */
+	int64_t start_tick;  /* Value of 'tick' when the game was last started */
+	const uint64_t *walls; /* Level walls in occupancy layout, NULL if there are none */
+	void (*body_foreach)(void *source, void func(void *xy, void *context), void *context); /* Tail first */
+	void *source;
+} ObserveFrame;
+
+/*
+ * Returns the bytes of one observation.
+ */
+size_t observe_size(int width, int height, const GameObserveLayout *layout);
+
+/*
+ * Writes the planes of 'frame' to 'dst'. Only the cells that changed since the last call
+ * are written when 'layout' shows that 'dst' holds the previous tick of the same game.
+ */
+void observe_write(const ObserveFrame *frame, GameObserveLayout *layout, void *dst);
+
+#endif // !OBSERVE
@@ -0,0 +1,30 @@
+#ifndef RANDOM
+#define RANDOM
+
+#include <stdint.h>
+
+/*
+ * Small PCG32 generator. Every game owns one, so runs can be reproduced from a seed
+ * and separate games never share generator state.
+ */
+typedef struct Random {
+	uint64_t state;
+	uint64_t inc;
+} Random;
+
+/*
+ * Seeds the generator. Equal seeds produce equal sequences.
+ */
+void random_seed(Random *r, uint64_t seed);
+
+/*
+ * Returns the next uniformly distributed 32 bit number.
+ */
+uint32_t random_next(Random *r);
+
+/*
+ * Returns a uniformly distributed number in [0, bound). 'bound' must be greater than 0.
+ */
+uint32_t random_bounded(Random *r, uint32_t bound);
+
+#endif
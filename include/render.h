@@ -43,6 +43,9 @@ void render_ctx_write(RenderContext *ctx, int position, int n, const float *vert
 /** Updates the render context (Uploads vertecies to the gpu). */
 void render_ctx_update(RenderContext *ctx);
 
+/** Uploads 'n' instances from 'position' on to the gpu, leaving the rest of the buffer as it is. */
+void render_ctx_update_range(RenderContext *ctx, int position, int n);
+
 /** Draw using a render context. */
 void render_ctx_draw(RenderContext *ctx);
 
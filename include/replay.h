@@ -0,0 +1,84 @@
+#ifndef REPLAY
+#define REPLAY
+
+#include <stddef.h>
+#include <stdint.h>
+#include "game.h"
+
+/*
+ * Replay file layout:
+ *   "SNKR", version byte, then varints: seed, width, height, start x, start y, GameFlags.
+ *   Events follow as varint((tick delta << 3) | ReplayEvent), the delta counting game_update
+ *   calls since the previous event. The file ends with REPLAY_END.
+ *
+ * Varints are little endian base 128: 7 bits per byte, high bit set on every byte but the last.
+ */
+
+#define REPLAY_MAGIC   "SNKR"
+#define REPLAY_VERSION 1
+
+typedef enum ReplayEvent {
+	REPLAY_END = 0, /* Session over, the game was alive until this tick */
+	/* 1 to 4 are turns, equal to GameSnakeDirection */
+	REPLAY_LOST = 5, /* game_update returned 1 on this tick, the game was started again */
+} ReplayEvent;
+
+typedef struct ReplayHeader {
+	uint64_t seed;
+	int width, height;
+	int start_x, start_y; /* Passed to game_start for every episode */
+	int flags;            /* GameFlags */
+} ReplayHeader;
+
+typedef struct ReplayResult {
+	int valid;
+	const char *error; /* Why the replay is invalid, NULL if it is valid */
+	int64_t ticks;     /* Ticks simulated */
+	int episodes;      /* Games played, the last one included */
+	int score;         /* Food eaten in the last game */
+	int best;          /* Most food eaten in one game */
+} ReplayResult;
+
+#define REPLAY_MAX_CELLS (1 << 24) /* Largest board a replay may ask for, unless GAME_CHUNKED */
+#define REPLAY_MAX_CHUNKED_SIDE (1 << 20) /* Longest side of a GAME_CHUNKED board, which is simulated cell by cell along a straight run */
+
+#ifdef REPLAY_INTERNAL
+
+#include <pthread.h>
+#include <stdio.h>
+
+#define REPLAY_BUFFER 4096
+
+/* Events go into the active buffer. The other one is written by the flush thread. */
+typedef struct Replay {
+	FILE *file;
+	int64_t tick;             /* Tick of the last event */
+	unsigned char *buffers[2];
+	int used[2];
+	int active;
+	int full;                 /* The inactive buffer waits to be written */
+	int stop;
+	int failed;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;      /* Flush thread: a buffer is full or the replay is closing */
+	pthread_cond_t written;   /* Writers: the inactive buffer is free again */
+} Replay;
+#endif
+
+#ifndef REPLAY_INTERNAL
+typedef void Replay;
+#endif // !REPLAY_INTERNAL
+
+Replay *replay_create(const char *path, const ReplayHeader *header); /* Opens a replay for writing. Returns NULL if the file can't be created or its writer thread can't be started. */
+void    replay_turn(Replay *replay, int64_t tick, GameSnakeDirection direction); /* Records a turn accepted by game_set_snake_direction. 'tick' is game_ticks at that moment. */
+void    replay_lost(Replay *replay, int64_t tick); /* Records a game_update that returned 1. 'tick' is game_ticks after it. */
+void    replay_destroy(Replay *replay, int64_t tick); /* Records the end of the session, writes everything out and closes the file. */
+
+int     replay_header_read(const void *data, size_t size, ReplayHeader *header); /* Returns the size of the header, 0 if it is malformed. */
+void    replay_run(const void *data, size_t size, int64_t max_ticks, ReplayResult *result); /* Plays a replay back and checks every event against the game. Stops as invalid after 'max_ticks'. */
+
+int     replay_varint_write(unsigned char *dst, uint64_t value); /* Returns the number of bytes written, at most 10. */
+int     replay_varint_read(const unsigned char *src, const unsigned char *end, uint64_t *value); /* Returns the number of bytes read, 0 if the varint is cut off or too long. */
+
+#endif // Replay
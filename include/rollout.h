@@ -0,0 +1,84 @@
+#ifndef ROLLOUT
+#define ROLLOUT
+
+#include <stdint.h>
+#include "batch.h"
+#include "random.h"
+#include "scheduler.h"
+
+/*
+ * Chooses actions for 'count' games starting at global game index 'first'.
+ * 'random' belongs to the shard, so the choices do not depend on which worker runs it.
+ */
+typedef void (*RolloutPolicy)(void *context, int first, int count, Random *random, GameSnakeDirection *actions);
+
+#ifdef ROLLOUT_INTERNAL
+
+struct Rollout;
+
+typedef struct RolloutShard {
+	struct Rollout *rollout;
+	GameBatch *batch;
+	int first;                   /* Global index of the first game */
+	int count;
+	int home;                    /* Worker the shard is queued on */
+	int remaining;               /* Steps left in free running mode */
+	Random random;
+	GameSnakeDirection *actions; /* Scratch for free running mode */
+	float *rewards;
+	unsigned char *dones;
+	const GameSnakeDirection *step_actions; /* Arguments of rollout_step */
+	float *step_rewards;
+	unsigned char *step_dones;
+	int64_t steps, episodes, food;
+} RolloutShard;
+
+typedef struct Rollout {
+	Scheduler *scheduler;
+	int games;
+	int shard_count;
+	RolloutShard *shards;
+	RolloutPolicy policy;
+	void *policy_context;
+} Rollout;
+#endif
+
+#ifndef ROLLOUT_INTERNAL
+typedef void Rollout;
+#endif
+
+typedef struct RolloutStats {
+	int64_t steps;    /* Game steps taken */
+	int64_t episodes; /* Lost games */
+	int64_t food;     /* Eaten food */
+} RolloutStats;
+
+/*
+ * Splits 'games' games into batches of up to 'shard_games' games and spreads them over the workers of 's'.
+ * Game 'i' is seeded with 'seed + i', like in a single batch.
+ */
+Rollout *rollout_create(Scheduler *s, int games, int width, int height, int shard_games, uint64_t seed);
+
+/*
+ * Steps every game once. Arrays are indexed by global game index, like game_batch_step.
+ * Shards are stepped independently; there is no barrier between workers, only a wait for the last shard.
+ */
+void rollout_step(Rollout *r, const GameSnakeDirection *actions, float *rewards, unsigned char *dones);
+
+/*
+ * Lets every shard run 'steps' steps on its own, asking 'policy' for actions.
+ * Shards are requeued in small slices so idle workers can steal them.
+ */
+void rollout_run(Rollout *r, int steps, RolloutPolicy policy, void *context);
+
+/*
+ * Gets the totals of all rollout_step and rollout_run calls.
+ */
+void rollout_stats(Rollout *r, RolloutStats *stats);
+
+/*
+ * Destroys the rollout. The scheduler is not destroyed.
+ */
+void rollout_destroy(Rollout *r);
+
+#endif // !ROLLOUT
@@ -0,0 +1,77 @@
+#ifndef SCHEDULER
+#define SCHEDULER
+
+/*
+ * A task receives its argument and the index of the worker running it.
+ */
+typedef void (*SchedulerTask)(void *arg, int worker);
+
+#ifdef SCHEDULER_INTERNAL
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+typedef struct SchedulerJob {
+	SchedulerTask task;
+	void *arg;
+} SchedulerJob;
+
+/* Owner pushes and pops at the bottom, thieves take from the top. */
+typedef struct SchedulerDeque {
+	pthread_mutex_t lock;
+	int top, bottom; /* Grow without wrapping, slots are taken modulo capacity */
+	int capacity;    /* Power of two */
+	SchedulerJob *jobs;
+} SchedulerDeque;
+
+typedef struct Scheduler {
+	int workers;
+	pthread_t *threads;
+	SchedulerDeque *deques;
+	atomic_int queued;  /* Jobs sitting in deques */
+	atomic_int pending; /* Jobs submitted but not finished */
+	atomic_uint next;   /* Round robin target of scheduler_submit */
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_cond_t done;
+	int sleeping;
+	int stop;
+} Scheduler;
+#endif
+
+#ifndef SCHEDULER_INTERNAL
+typedef void Scheduler;
+#endif
+
+/*
+ * Starts a pool of 'workers' threads, each with its own deque. Idle workers steal from the others.
+ * If 'workers' is 0 or less, one worker per online cpu is started.
+ */
+Scheduler *scheduler_create(int workers);
+
+/*
+ * Returns the number of workers.
+ */
+int scheduler_workers(Scheduler *s);
+
+/*
+ * Queues a task on the next worker in round robin order.
+ */
+void scheduler_submit(Scheduler *s, SchedulerTask task, void *arg);
+
+/*
+ * Queues a task on the deque of 'worker'. Tasks may submit follow-up work to their own worker this way.
+ */
+void scheduler_submit_to(Scheduler *s, int worker, SchedulerTask task, void *arg);
+
+/*
+ * Blocks until every submitted task, including tasks submitted by tasks, has finished.
+ */
+void scheduler_wait(Scheduler *s);
+
+/*
+ * Stops the workers and destroys the scheduler. Queued tasks are finished first.
+ */
+void scheduler_destroy(Scheduler *s);
+
+#endif // !SCHEDULER
@@ -0,0 +1,265 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LEVEL_INTERNAL
+#include "level.h"
+
+#define LEVEL_MAX_SIDE 32767 /* Keeps distances within uint16_t */
+
+size_t internal_level_size(int width, int height, int row_words, int flags)
+{
+	size_t size = sizeof(LevelHeader) + (size_t)height * row_words * sizeof(uint64_t);
+	if (flags & LEVEL_DISTANCE) {
+		size += (size_t)width * height * sizeof(uint16_t);
+	}
+	return size;
+}
+
+int internal_level_bit(const uint64_t *walls, int row_words, int x, int y)
+{
+	return (walls[y * row_words + (x >> 6)] >> (x & 63)) & 1;
+}
+
+/* Returns 1 if no row has a wall bit set past the width, in the padding of its last word. */
+int internal_level_padding_clear(const uint64_t *walls, int width, int height, int row_words)
+{
+	if ((width & 63) == 0) {
+		return 1;
+	}
+	uint64_t padding = ~(((uint64_t)1 << (width & 63)) - 1);
+	for (int y = 0; y < height; ++y) {
+		if (walls[y * row_words + row_words - 1] & padding) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Breadth first search from every wall and from the outside of the map at once. */
+void internal_level_distance(int width, int height, const unsigned char *walls, uint16_t *distance)
+{
+	int cells = width * height;
+	int *queue = malloc(cells * sizeof(*queue));
+	int head = 0, tail = 0;
+	for (int cell = 0; cell < cells; ++cell) {
+		distance[cell] = walls[cell] ? 0 : UINT16_MAX;
+		if (walls[cell]) {
+			queue[tail++] = cell;
+		}
+	}
+	/* The outside is one step away from the border. Queued after the walls so distances stay in order. */
+	for (int cell = 0; cell < cells; ++cell) {
+		int x = cell % width, y = cell / width;
+		if (!walls[cell] && (x == 0 || y == 0 || x == width - 1 || y == height - 1)) {
+			distance[cell] = 1;
+			queue[tail++] = cell;
+		}
+	}
+
+	const int dx[] = { 1, -1, 0, 0 };
+	const int dy[] = { 0, 0, 1, -1 };
+	while (head < tail) {
+		int cell = queue[head++];
+		int x = cell % width, y = cell / width;
+		for (int d = 0; d < 4; ++d) {
+			int nx = x + dx[d], ny = y + dy[d];
+			if (nx < 0 || ny < 0 || nx >= width || ny >= height) {
+				continue;
+			}
+			int next = ny * width + nx;
+			if (distance[next] > distance[cell] + 1) {
+				distance[next] = distance[cell] + 1;
+				queue[tail++] = next;
+			}
+		}
+	}
+	free(queue);
+}
+
+Level *level_open(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st)) {
+		fprintf(stderr, "Failed to open the level '%s': %s\n", path, strerror(errno));
+		if (fd >= 0) close(fd);
+		return NULL;
+	}
+	if ((size_t)st.st_size < sizeof(LevelHeader)) {
+		fprintf(stderr, "The level '%s' is too small.\n", path);
+		close(fd);
+		return NULL;
+	}
+
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Failed to map the level '%s': %s\n", path, strerror(errno));
+		return NULL;
+	}
+
+	const LevelHeader *header = map;
+	int valid = !memcmp(header->magic, LEVEL_MAGIC, 4) && header->version == LEVEL_VERSION
+		&& header->width >= 1 && header->width <= LEVEL_MAX_SIDE
+		&& header->height >= 1 && header->height <= LEVEL_MAX_SIDE
+		&& header->row_words == (header->width + 63) / 64
+		&& !(header->flags & ~LEVEL_DISTANCE)
+		&& (size_t)st.st_size == internal_level_size(header->width, header->height, header->row_words, header->flags)
+		&& header->start_x < header->width && header->start_y < header->height;
+	const uint64_t *walls = (const uint64_t *)(header + 1);
+	if (!valid || internal_level_bit(walls, header->row_words, header->start_x, header->start_y)
+		|| !internal_level_padding_clear(walls, header->width, header->height, header->row_words)) {
+		fprintf(stderr, "The level '%s' is malformed.\n", path);
+		munmap(map, st.st_size);
+		return NULL;
+	}
+
+	uint64_t wall_count = 0;
+	for (size_t i = 0; i < (size_t)header->height * header->row_words; ++i) {
+		wall_count += __builtin_popcountll(walls[i]);
+	}
+	if (wall_count != header->wall_count) {
+		fprintf(stderr, "The level '%s' is malformed.\n", path);
+		munmap(map, st.st_size);
+		return NULL;
+	}
+
+	Level *level = malloc(sizeof(*level));
+	level->map = map;
+	level->map_size = st.st_size;
+	level->header = header;
+	level->walls = walls;
+	level->distance = (header->flags & LEVEL_DISTANCE) ? (const uint16_t *)(walls + (size_t)header->height * header->row_words) : NULL;
+	atomic_init(&level->open, NULL);
+	return level;
+}
+
+int level_write(const char *path, int width, int height, int start_x, int start_y, const unsigned char *walls, int distance)
+{
+	if (width < 1 || height < 1 || width > LEVEL_MAX_SIDE || height > LEVEL_MAX_SIDE ||
+		start_x < 0 || start_y < 0 || start_x >= width || start_y >= height || walls[start_y * width + start_x]) {
+		fprintf(stderr, "Refusing to write the level '%s', its size or start is invalid.\n", path);
+		return -1;
+	}
+
+	LevelHeader header = { LEVEL_MAGIC, LEVEL_VERSION, width, height, start_x, start_y,
+		(width + 63) / 64, distance ? LEVEL_DISTANCE : 0, 0, 0 };
+	size_t size = internal_level_size(width, height, header.row_words, header.flags);
+	char *data = calloc(1, size);
+	uint64_t *bits = (uint64_t *)(data + sizeof(header));
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			if (walls[y * width + x]) {
+				bits[y * header.row_words + (x >> 6)] |= (uint64_t)1 << (x & 63);
+				header.wall_count++;
+			}
+		}
+	}
+	if (distance) {
+		internal_level_distance(width, height, walls, (uint16_t *)(bits + (size_t)height * header.row_words));
+	}
+	memcpy(data, &header, sizeof(header));
+
+	FILE *file = fopen(path, "wb");
+	int failed = !file || fwrite(data, 1, size, file) != size;
+	if (file && fclose(file)) {
+		failed = 1;
+	}
+	if (failed) {
+		fprintf(stderr, "Failed to write the level '%s': %s\n", path, strerror(errno));
+	}
+	free(data);
+	return failed ? -1 : 0;
+}
+
+int level_width(const Level *level)
+{
+	return level->header->width;
+}
+
+int level_height(const Level *level)
+{
+	return level->header->height;
+}
+
+void level_start(const Level *level, int *position)
+{
+	position[0] = level->header->start_x;
+	position[1] = level->header->start_y;
+}
+
+int level_wall_count(const Level *level)
+{
+	return level->header->wall_count;
+}
+
+const uint64_t *level_walls(const Level *level)
+{
+	return level->walls;
+}
+
+/* Builds the open cells and their index once. Threads that race here free their copy and use the winner's. */
+int *internal_level_open(const Level *level)
+{
+	Level *shared = (Level *)level;
+	int *open = atomic_load_explicit(&shared->open, memory_order_acquire);
+	if (open) {
+		return open;
+	}
+
+	int cells = level->header->width * level->header->height;
+	int *open_cells = malloc(2 * (size_t)cells * sizeof(*open_cells));
+	int *open_index = open_cells + cells;
+	int open_count = 0;
+	for (int cell = 0; cell < cells; ++cell) {
+		int wall = internal_level_bit(level->walls, level->header->row_words, cell % level->header->width, cell / level->header->width);
+		open_index[cell] = wall ? -1 : open_count;
+		if (!wall) {
+			open_cells[open_count++] = cell;
+		}
+	}
+	if (!atomic_compare_exchange_strong_explicit(&shared->open, &open, open_cells, memory_order_acq_rel, memory_order_acquire)) {
+		free(open_cells);
+		return open;
+	}
+	return open_cells;
+}
+
+const int *level_open_cells(const Level *level)
+{
+	return internal_level_open(level);
+}
+
+const int *level_open_index(const Level *level)
+{
+	return internal_level_open(level) + level->header->width * level->header->height;
+}
+
+int level_is_wall(const Level *level, int x, int y)
+{
+	if (x < 0 || y < 0 || x >= (int)level->header->width || y >= (int)level->header->height) {
+		return 1;
+	}
+	return internal_level_bit(level->walls, level->header->row_words, x, y);
+}
+
+int level_distance(const Level *level, int x, int y)
+{
+	if (!level->distance || x < 0 || y < 0 || x >= (int)level->header->width || y >= (int)level->header->height) {
+		return -1;
+	}
+	return level->distance[y * level->header->width + x];
+}
+
+void level_close(Level *level)
+{
+	munmap(level->map, level->map_size);
+	free(atomic_load(&level->open));
+	free(level);
+}
@@ -0,0 +1,143 @@
+#include <string.h>
+
+#include "observe.h"
+
+#define OBSERVE_U8_MAX 255
+#define OBSERVE_F32_MAX (1 << 24) /* Largest run of integers a float holds exactly */
+
+typedef struct {
+	const GameObserveLayout *layout;
+	void *plane;
+	int columns;
+	int64_t push;
+} ObserveBody_callback;
+
+size_t internal_observe_element(const GameObserveLayout *layout)
+{
+	return layout->type == GAME_OBSERVE_F32 ? sizeof(float) : sizeof(uint8_t);
+}
+
+void internal_observe_set(const GameObserveLayout *layout, void *plane, int index, int value)
+{
+	if (layout->type == GAME_OBSERVE_F32) {
+		((float *)plane)[index] = value;
+	} else {
+		((uint8_t *)plane)[index] = value > OBSERVE_U8_MAX ? OBSERVE_U8_MAX : value;
+	}
+}
+
+/* Sets 'count' cells from 'index' on. Zero is all zero bits in both types, so clearing is a memset. */
+void internal_observe_fill(const GameObserveLayout *layout, void *plane, int index, int count, int value)
+{
+	if (layout->type == GAME_OBSERVE_U8 || value == 0) {
+		size_t element = internal_observe_element(layout);
+		memset((char *)plane + index * element, value, count * element);
+		return;
+	}
+	float *cells = (float *)plane + index;
+	for (int i = 0; i < count; ++i) {
+		cells[i] = value;
+	}
+}
+
+/* Body value of the segment pushed 'push'-th since game_start, 1 to P. */
+int internal_observe_stamp(const GameObserveLayout *layout, int64_t push)
+{
+	int period = layout->type == GAME_OBSERVE_F32 ? OBSERVE_F32_MAX : OBSERVE_U8_MAX;
+	return 1 + (int)((push - 1) % period);
+}
+
+int internal_observe_index(const ObserveFrame *frame, int p, int columns, int cell)
+{
+	return (cell / frame->width + p) * columns + cell % frame->width + p;
+}
+
+void internal_observe_body(void *xy, void *context)
+{
+	ObserveBody_callback *instance = context;
+	int index = (((int *)xy)[1] + instance->layout->padding) * instance->columns + ((int *)xy)[0] + instance->layout->padding;
+	internal_observe_set(instance->layout, instance->plane, index, internal_observe_stamp(instance->layout, instance->push++));
+}
+
+size_t observe_size(int width, int height, const GameObserveLayout *layout)
+{
+	return (size_t)GAME_PLANES * (width + 2 * layout->padding) * (height + 2 * layout->padding) * internal_observe_element(layout);
+}
+
+void observe_write(const ObserveFrame *frame, GameObserveLayout *layout, void *dst)
+{
+	int p = layout->padding;
+	int columns = frame->width + 2 * p;
+	int rows = frame->height + 2 * p;
+	int plane_cells = columns * rows;
+	size_t plane_bytes = plane_cells * internal_observe_element(layout);
+	void *head = dst;
+	void *body = (char *)dst + GAME_PLANE_BODY * plane_bytes;
+	void *food = (char *)dst + GAME_PLANE_FOOD * plane_bytes;
+	void *wall = (char *)dst + GAME_PLANE_WALL * plane_bytes;
+
+	int head_index = internal_observe_index(frame, p, columns, frame->head);
+	int food_index = frame->food < 0 ? -1 : internal_observe_index(frame, p, columns, frame->food);
+
+	/*
+	 * A segment's value only depends on when it was pushed, so successive ticks only touch the
+	 * ends of the body: the head gets the next value and the cell the tail left is cleared.
+	 */
+	int incremental = layout->written && layout->start_tick == frame->start_tick
+		&& frame->tick - layout->tick >= 0 && frame->tick - layout->tick <= 1;
+
+	if (!incremental) {
+		memset(dst, 0, GAME_PLANES * plane_bytes);
+		internal_observe_fill(layout, wall, 0, p * columns, 1);
+		for (int y = p; y < p + frame->height; ++y) {
+			internal_observe_fill(layout, wall, y * columns, p, 1);
+			internal_observe_fill(layout, wall, y * columns + p + frame->width, p, 1);
+		}
+		internal_observe_fill(layout, wall, (p + frame->height) * columns, p * columns, 1);
+		if (frame->walls) {
+			int row_words = (frame->width + 63) / 64;
+			for (int y = 0; y < frame->height; ++y) {
+				for (int w = 0; w < row_words; ++w) {
+					for (uint64_t bits = frame->walls[y * row_words + w]; bits; bits &= bits - 1) {
+						int x = w * 64 + __builtin_ctzll(bits);
+						internal_observe_set(layout, wall, (y + p) * columns + x + p, 1);
+					}
+				}
+			}
+		}
+
+		ObserveBody_callback fill = { layout, body, columns, frame->pushes - frame->body_size + 1 };
+		frame->body_foreach(frame->source, internal_observe_body, &fill);
+		internal_observe_set(layout, head, head_index, 1);
+		if (food_index >= 0) {
+			internal_observe_set(layout, food, food_index, 1);
+		}
+	} else {
+		int old_head = internal_observe_index(frame, p, columns, layout->head);
+		if (old_head != head_index) {
+			/* One push per move, and a pop unless the body grew. */
+			if (layout->body_size == frame->body_size) {
+				internal_observe_set(layout, body, internal_observe_index(frame, p, columns, layout->tail), 0);
+			}
+			internal_observe_set(layout, body, head_index, internal_observe_stamp(layout, frame->pushes));
+			internal_observe_set(layout, head, old_head, 0);
+			internal_observe_set(layout, head, head_index, 1);
+		}
+		if (layout->food != frame->food) {
+			if (layout->food >= 0) {
+				internal_observe_set(layout, food, internal_observe_index(frame, p, columns, layout->food), 0);
+			}
+			if (food_index >= 0) {
+				internal_observe_set(layout, food, food_index, 1);
+			}
+		}
+	}
+
+	layout->written = 1;
+	layout->head = frame->head;
+	layout->food = frame->food;
+	layout->tail = frame->tail;
+	layout->body_size = frame->body_size;
+	layout->tick = frame->tick;
+	layout->start_tick = frame->start_tick;
+}
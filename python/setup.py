@@ -0,0 +1,16 @@
+from setuptools import Extension, setup
+
+core = ["batch.c", "observe.c", "random.c"]
+
+setup(
+    name="snakeenv",
+    version="0.1",
+    ext_modules=[
+        Extension(
+            "snakeenv",
+            sources=["snakeenv.c"] + ["../" + source for source in core],
+            include_dirs=["../include"],
+            extra_compile_args=["-O2", "-Wall", "-Wextra"],
+        )
+    ],
+)
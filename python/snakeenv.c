@@ -0,0 +1,438 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+
+/*
+ * Vectorized environment over GameBatch. Observations, rewards, dones and actions live in
+ * C memory owned by the environment and are handed out as buffers, so numpy.asarray and
+ * torch.frombuffer wrap them without a copy. Stepping runs without the GIL.
+ */
+
+typedef struct {
+	PyObject_HEAD
+	GameBatch *batch;
+	int count;
+	GameObserveLayout *layouts;
+	Py_ssize_t observation_shape[4]; /* games, planes, rows, columns */
+	Py_ssize_t observation_itemsize;
+	const char *observation_format;
+	void *observations;
+	float *rewards;
+	unsigned char *dones;
+	int *actions; /* GameSnakeDirection, writable from Python */
+	GameSnakeDirection *directions; /* Checked copy of 'actions' that step hands to the batch */
+	int busy;     /* A step is running without the GIL */
+} VecEnvObject;
+
+/* View of one array of a VecEnv. Keeps the environment alive while it is exported. */
+typedef struct {
+	PyObject_HEAD
+	VecEnvObject *env;
+	void *data;
+	const char *format;
+	Py_ssize_t itemsize;
+	int ndim;
+	int readonly;
+	Py_ssize_t shape[4];
+	Py_ssize_t strides[4];
+} ArrayObject;
+
+static PyTypeObject ArrayType;
+
+static int array_getbuffer(ArrayObject *self, Py_buffer *view, int flags)
+{
+	if ((flags & PyBUF_WRITABLE) && self->readonly) {
+		PyErr_SetString(PyExc_BufferError, "Array is read only.");
+		view->obj = NULL;
+		return -1;
+	}
+
+	Py_ssize_t length = self->itemsize;
+	for (int i = 0; i < self->ndim; ++i) {
+		length *= self->shape[i];
+	}
+
+	view->obj = (PyObject *)self;
+	Py_INCREF(self);
+	view->buf = self->data;
+	view->len = length;
+	view->readonly = self->readonly;
+	view->itemsize = self->itemsize;
+	view->format = (flags & PyBUF_FORMAT) ? (char *)self->format : NULL;
+	view->ndim = self->ndim;
+	view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+	view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : NULL;
+	view->suboffsets = NULL;
+	view->internal = NULL;
+	return 0;
+}
+
+static void array_dealloc(ArrayObject *self)
+{
+	Py_XDECREF(self->env);
+	Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyBufferProcs array_as_buffer = {
+	(getbufferproc)array_getbuffer,
+	NULL,
+};
+
+static PyTypeObject ArrayType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "snakeenv.Array",
+	.tp_basicsize = sizeof(ArrayObject),
+	.tp_dealloc = (destructor)array_dealloc,
+	.tp_as_buffer = &array_as_buffer,
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_doc = "C memory of a VecEnv, exported through the buffer protocol.",
+};
+
+/* Returns a memoryview of 'ndim' dimensions over 'data'. */
+static PyObject *internal_array_view(VecEnvObject *env, void *data, const char *format, Py_ssize_t itemsize,
+	int ndim, const Py_ssize_t *shape, int readonly)
+{
+	ArrayObject *array = PyObject_New(ArrayObject, &ArrayType);
+	if (!array) {
+		return NULL;
+	}
+	Py_INCREF(env);
+	array->env = env;
+	array->data = data;
+	array->format = format;
+	array->itemsize = itemsize;
+	array->ndim = ndim;
+	array->readonly = readonly;
+	Py_ssize_t stride = itemsize;
+	for (int i = ndim - 1; i >= 0; --i) {
+		array->shape[i] = shape[i];
+		array->strides[i] = stride;
+		stride *= shape[i];
+	}
+
+	PyObject *view = PyMemoryView_FromObject((PyObject *)array);
+	Py_DECREF(array);
+	return view;
+}
+
+static PyObject *internal_observations(VecEnvObject *self)
+{
+	return internal_array_view(self, self->observations, self->observation_format, self->observation_itemsize,
+		4, self->observation_shape, 1);
+}
+
+static PyObject *internal_rewards(VecEnvObject *self)
+{
+	Py_ssize_t shape[] = { self->count };
+	return internal_array_view(self, self->rewards, "f", sizeof(float), 1, shape, 1);
+}
+
+static PyObject *internal_dones(VecEnvObject *self)
+{
+	Py_ssize_t shape[] = { self->count };
+	return internal_array_view(self, self->dones, "B", 1, 1, shape, 1);
+}
+
+/* Copies any integer buffer or sequence of 'count' actions into self->actions. */
+static int internal_actions_load(VecEnvObject *self, PyObject *actions)
+{
+	Py_buffer view;
+	if (PyObject_GetBuffer(actions, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) == 0) {
+		const char *format = view.format ? view.format : "B";
+		if (*format == '<' || *format == '=' || *format == '@') {
+			format++;
+		}
+		int ok = view.len == (Py_ssize_t)self->count * view.itemsize && *format != '\0' && strchr("bBhHiIlLqQ", *format) && format[1] == '\0';
+		for (int i = 0; ok && i < self->count; ++i) {
+			const char *item = (const char *)view.buf + i * view.itemsize;
+			long long value;
+			switch (view.itemsize) {
+				case 1: value = *format == 'b' ? *(const int8_t *)item : *(const uint8_t *)item; break;
+				case 2: value = *(const int16_t *)item; break;
+				case 4: value = *(const int32_t *)item; break;
+				case 8: value = *(const int64_t *)item; break;
+				default: ok = 0; continue;
+			}
+			ok = value >= GSD_NONE && value <= GSD_LEFT;
+			self->actions[i] = (int)value;
+		}
+		PyBuffer_Release(&view);
+		if (!ok) {
+			PyErr_Format(PyExc_ValueError, "Expected %d integer actions between 0 and 4.", self->count);
+		}
+		return ok ? 0 : -1;
+	}
+	PyErr_Clear();
+
+	PyObject *sequence = PySequence_Fast(actions, "Actions must be a buffer or a sequence.");
+	if (!sequence) {
+		return -1;
+	}
+	if (PySequence_Fast_GET_SIZE(sequence) != self->count) {
+		PyErr_Format(PyExc_ValueError, "Expected %d actions.", self->count);
+		Py_DECREF(sequence);
+		return -1;
+	}
+	for (int i = 0; i < self->count; ++i) {
+		long value = PyLong_AsLong(PySequence_Fast_GET_ITEM(sequence, i));
+		if (value == -1 && PyErr_Occurred()) {
+			Py_DECREF(sequence);
+			return -1;
+		}
+		if (value < GSD_NONE || value > GSD_LEFT) {
+			PyErr_SetString(PyExc_ValueError, "Actions must be between 0 and 4.");
+			Py_DECREF(sequence);
+			return -1;
+		}
+		self->actions[i] = (int)value;
+	}
+	Py_DECREF(sequence);
+	return 0;
+}
+
+/* Range checks self->actions into self->directions. Python can write any int to self->actions, so every step does this. */
+static int internal_directions_load(VecEnvObject *self)
+{
+	for (int i = 0; i < self->count; ++i) {
+		if (self->actions[i] < GSD_NONE || self->actions[i] > GSD_LEFT) {
+			PyErr_Format(PyExc_ValueError, "VecEnv.actions[%d] is %d, actions must be between 0 and 4.", i, self->actions[i]);
+			return -1;
+		}
+		self->directions[i] = (GameSnakeDirection)self->actions[i];
+	}
+	return 0;
+}
+
+static int vecenv_init(VecEnvObject *self, PyObject *args, PyObject *kwargs)
+{
+	static char *keywords[] = { "num_envs", "width", "height", "seed", "dtype", "padding", NULL };
+	int count, width = 15, height = 15, padding = 0;
+	unsigned long long seed = 0;
+	const char *dtype = "uint8";
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "i|iiKsi", keywords, &count, &width, &height, &seed, &dtype, &padding)) {
+		return -1;
+	}
+	if (self->batch) {
+		PyErr_SetString(PyExc_RuntimeError, "VecEnv is already initialized.");
+		return -1;
+	}
+	if (count < 1 || width < 2 || height < 2 || padding < 0) {
+		PyErr_SetString(PyExc_ValueError, "Expected at least one game, a board of at least 2x2 and no negative padding.");
+		return -1;
+	}
+
+	GameObserveLayout layout = { 0 };
+	if (!strcmp(dtype, "uint8")) {
+		layout.type = GAME_OBSERVE_U8;
+		self->observation_format = "B";
+		self->observation_itemsize = 1;
+	} else if (!strcmp(dtype, "float32")) {
+		layout.type = GAME_OBSERVE_F32;
+		self->observation_format = "f";
+		self->observation_itemsize = sizeof(float);
+	} else {
+		PyErr_SetString(PyExc_ValueError, "dtype must be 'uint8' or 'float32'.");
+		return -1;
+	}
+	layout.padding = padding;
+
+	self->count = count;
+	self->observation_shape[0] = count;
+	self->observation_shape[1] = GAME_PLANES;
+	self->observation_shape[2] = height + 2 * padding;
+	self->observation_shape[3] = width + 2 * padding;
+
+	self->layouts = malloc(count * sizeof(*self->layouts));
+	self->observations = malloc((size_t)count * GAME_PLANES * self->observation_shape[2] * self->observation_shape[3] * self->observation_itemsize);
+	self->rewards = calloc(count, sizeof(*self->rewards));
+	self->dones = calloc(count, 1);
+	self->actions = calloc(count, sizeof(*self->actions));
+	self->directions = calloc(count, sizeof(*self->directions));
+	if (!self->layouts || !self->observations || !self->rewards || !self->dones || !self->actions || !self->directions) {
+		PyErr_NoMemory();
+		return -1;
+	}
+	for (int i = 0; i < count; ++i) {
+		self->layouts[i] = layout;
+	}
+
+	Py_BEGIN_ALLOW_THREADS
+	self->batch = game_batch_create(count, width, height, seed);
+	game_batch_observe(self->batch, self->layouts, self->observations);
+	Py_END_ALLOW_THREADS
+	return 0;
+}
+
+static void vecenv_dealloc(VecEnvObject *self)
+{
+	if (self->batch) {
+		game_batch_destroy(self->batch);
+	}
+	free(self->layouts);
+	free(self->observations);
+	free(self->rewards);
+	free(self->dones);
+	free(self->actions);
+	free(self->directions);
+	Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int internal_vecenv_enter(VecEnvObject *self)
+{
+	if (!self->batch) {
+		PyErr_SetString(PyExc_RuntimeError, "VecEnv is not initialized.");
+		return -1;
+	}
+	if (self->busy) {
+		PyErr_SetString(PyExc_RuntimeError, "VecEnv is being stepped by another thread.");
+		return -1;
+	}
+	self->busy = 1;
+	return 0;
+}
+
+static PyObject *vecenv_reset(VecEnvObject *self, PyObject *unused)
+{
+	(void)unused;
+	if (internal_vecenv_enter(self)) {
+		return NULL;
+	}
+	Py_BEGIN_ALLOW_THREADS
+	game_batch_reset(self->batch);
+	game_batch_observe(self->batch, self->layouts, self->observations);
+	memset(self->rewards, 0, self->count * sizeof(*self->rewards));
+	memset(self->dones, 0, self->count);
+	Py_END_ALLOW_THREADS
+	self->busy = 0;
+	return internal_observations(self);
+}
+
+static PyObject *vecenv_step(VecEnvObject *self, PyObject *args)
+{
+	PyObject *actions = Py_None;
+	if (!PyArg_ParseTuple(args, "|O", &actions)) {
+		return NULL;
+	}
+	if (internal_vecenv_enter(self)) {
+		return NULL;
+	}
+	if ((actions != Py_None && internal_actions_load(self, actions)) || internal_directions_load(self)) {
+		self->busy = 0;
+		return NULL;
+	}
+
+	Py_BEGIN_ALLOW_THREADS
+	game_batch_step(self->batch, self->directions, self->rewards, self->dones);
+	game_batch_observe(self->batch, self->layouts, self->observations);
+	Py_END_ALLOW_THREADS
+	self->busy = 0;
+
+	PyObject *observations = internal_observations(self);
+	PyObject *rewards = internal_rewards(self);
+	PyObject *dones = internal_dones(self);
+	if (!observations || !rewards || !dones) {
+		Py_XDECREF(observations);
+		Py_XDECREF(rewards);
+		Py_XDECREF(dones);
+		return NULL;
+	}
+	return Py_BuildValue("(NNN)", observations, rewards, dones);
+}
+
+static PyObject *vecenv_get_observations(VecEnvObject *self, void *closure)
+{
+	(void)closure;
+	return internal_observations(self);
+}
+
+static PyObject *vecenv_get_rewards(VecEnvObject *self, void *closure)
+{
+	(void)closure;
+	return internal_rewards(self);
+}
+
+static PyObject *vecenv_get_dones(VecEnvObject *self, void *closure)
+{
+	(void)closure;
+	return internal_dones(self);
+}
+
+static PyObject *vecenv_get_actions(VecEnvObject *self, void *closure)
+{
+	(void)closure;
+	Py_ssize_t shape[] = { self->count };
+	return internal_array_view(self, self->actions, "i", sizeof(int), 1, shape, 0);
+}
+
+static PyObject *vecenv_get_num_envs(VecEnvObject *self, void *closure)
+{
+	(void)closure;
+	return PyLong_FromLong(self->count);
+}
+
+static PyMethodDef vecenv_methods[] = {
+	{ "reset", (PyCFunction)vecenv_reset, METH_NOARGS, "reset() -> observations\nStarts every game again." },
+	{ "step", (PyCFunction)vecenv_step, METH_VARARGS,
+		"step(actions=None) -> (observations, rewards, dones)\n"
+		"Advances every game by one update. Without 'actions' the contents of VecEnv.actions are used.\n"
+		"Lost games are restarted before step returns." },
+	{ NULL, NULL, 0, NULL },
+};
+
+static PyGetSetDef vecenv_getset[] = {
+	{ "observations", (getter)vecenv_get_observations, NULL, "uint8 or float32 (num_envs, planes, rows, columns), read only.", NULL },
+	{ "rewards", (getter)vecenv_get_rewards, NULL, "float32 (num_envs,) of the last step, read only.", NULL },
+	{ "dones", (getter)vecenv_get_dones, NULL, "uint8 (num_envs,) of the last step, read only.", NULL },
+	{ "actions", (getter)vecenv_get_actions, NULL, "int32 (num_envs,) used by step() when it gets no actions. Writable.", NULL },
+	{ "num_envs", (getter)vecenv_get_num_envs, NULL, "Number of games.", NULL },
+	{ NULL, NULL, NULL, NULL, NULL },
+};
+
+static PyTypeObject VecEnvType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "snakeenv.VecEnv",
+	.tp_basicsize = sizeof(VecEnvObject),
+	.tp_dealloc = (destructor)vecenv_dealloc,
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_doc = "VecEnv(num_envs, width=15, height=15, seed=0, dtype='uint8', padding=0)\n"
+		"Game i is seeded with seed + i. Planes are head, body, food and wall, see game_observe.",
+	.tp_methods = vecenv_methods,
+	.tp_getset = vecenv_getset,
+	.tp_init = (initproc)vecenv_init,
+	.tp_new = PyType_GenericNew,
+};
+
+static struct PyModuleDef snakeenv_module = {
+	PyModuleDef_HEAD_INIT,
+	.m_name = "snakeenv",
+	.m_doc = "Vectorized snake environments over the C core.",
+	.m_size = -1,
+};
+
+PyMODINIT_FUNC PyInit_snakeenv(void)
+{
+	if (PyType_Ready(&ArrayType) < 0 || PyType_Ready(&VecEnvType) < 0) {
+		return NULL;
+	}
+
+	PyObject *module = PyModule_Create(&snakeenv_module);
+	if (!module) {
+		return NULL;
+	}
+	Py_INCREF(&VecEnvType);
+	if (PyModule_AddObject(module, "VecEnv", (PyObject *)&VecEnvType) < 0) {
+		Py_DECREF(&VecEnvType);
+		Py_DECREF(module);
+		return NULL;
+	}
+	PyModule_AddIntConstant(module, "NONE", GSD_NONE);
+	PyModule_AddIntConstant(module, "DOWN", GSD_DOWN);
+	PyModule_AddIntConstant(module, "UP", GSD_UP);
+	PyModule_AddIntConstant(module, "RIGHT", GSD_RIGHT);
+	PyModule_AddIntConstant(module, "LEFT", GSD_LEFT);
+	PyModule_AddIntConstant(module, "PLANES", GAME_PLANES);
+	return module;
+}
@@ -0,0 +1,33 @@
+#include <assert.h>
+#include "random.h"
+
+void random_seed(Random *r, uint64_t seed)
+{
+	r->state = 0;
+	r->inc = (0xda3e39cb94b95bdbULL << 1) | 1;
+	random_next(r);
+	r->state += seed;
+	random_next(r);
+}
+
+uint32_t random_next(Random *r)
+{
+	uint64_t old = r->state;
+	r->state = old * 6364136223846793005ULL + r->inc;
+	uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+	uint32_t rot = (uint32_t)(old >> 59);
+	return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+uint32_t random_bounded(Random *r, uint32_t bound)
+{
+	assert(bound > 0);
+	/* Rejects the low values that would make the modulo biased. */
+	uint32_t threshold = -bound % bound;
+	for (;;) {
+		uint32_t value = random_next(r);
+		if (value >= threshold) {
+			return value % bound;
+		}
+	}
+}
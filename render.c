@@ -145,6 +145,17 @@ void render_ctx_update(RenderContext *ctx)
 	assert(error == GL_NO_ERROR);
 }
 
+void render_ctx_update_range(RenderContext *ctx, int position, int n)
+{
+	assert(ctx->capacity >= position + n);
+	size_t instance = ctx->vertices_per_instance * sizeof(*ctx->vertices);
+	glBindBuffer(GL_ARRAY_BUFFER, ctx->buffers[0]);
+	glBufferSubData(GL_ARRAY_BUFFER, position * instance, n * instance, &ctx->vertices[position * ctx->vertices_per_instance]);
+
+	GLuint error = glGetError();
+	assert(error == GL_NO_ERROR);
+}
+
 void render_ctx_draw(RenderContext *ctx)
 {
 	glBindVertexArray(ctx->vao);
@@ -0,0 +1,297 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define REPLAY_INTERNAL
+#include "replay.h"
+
+#define REPLAY_FLUSH_SECONDS 1 /* Longest time an event stays in memory */
+
+int replay_varint_write(unsigned char *dst, uint64_t value)
+{
+	int n = 0;
+	while (value >= 0x80) {
+		dst[n++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	dst[n++] = (unsigned char)value;
+	return n;
+}
+
+int replay_varint_read(const unsigned char *src, const unsigned char *end, uint64_t *value)
+{
+	uint64_t result = 0;
+	for (int n = 0; n < 10 && src + n < end; ++n) {
+		result |= (uint64_t)(src[n] & 0x7f) << (7 * n);
+		if (!(src[n] & 0x80)) {
+			*value = result;
+			return n + 1;
+		}
+	}
+	return 0;
+}
+
+/* Hands the active buffer to the flush thread. Called with the lock held. */
+void internal_replay_swap(Replay *replay)
+{
+	replay->full = 1;
+	replay->active ^= 1;
+	replay->used[replay->active] = 0;
+	pthread_cond_signal(&replay->wake);
+}
+
+void *internal_replay_flush(void *arg)
+{
+	Replay *replay = arg;
+	int timed_out = 0;
+
+	pthread_mutex_lock(&replay->lock);
+	for (;;) {
+		if (!replay->full && replay->used[replay->active] > 0 && (timed_out || replay->stop)) {
+			internal_replay_swap(replay);
+		}
+		if (replay->full) {
+			int index = replay->active ^ 1;
+			pthread_mutex_unlock(&replay->lock);
+			size_t size = replay->used[index];
+			int failed = fwrite(replay->buffers[index], 1, size, replay->file) != size || fflush(replay->file);
+			pthread_mutex_lock(&replay->lock);
+			if (failed && !replay->failed) {
+				fprintf(stderr, "Failed to write the replay: %s\n", strerror(errno));
+				replay->failed = 1;
+			}
+			replay->full = 0;
+			pthread_cond_broadcast(&replay->written);
+			continue;
+		}
+		if (replay->stop) {
+			break;
+		}
+
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += REPLAY_FLUSH_SECONDS;
+		timed_out = pthread_cond_timedwait(&replay->wake, &replay->lock, &deadline) == ETIMEDOUT;
+	}
+	pthread_mutex_unlock(&replay->lock);
+	return NULL;
+}
+
+void internal_replay_append(Replay *replay, const unsigned char *bytes, int count)
+{
+	pthread_mutex_lock(&replay->lock);
+	if (replay->used[replay->active] + count > REPLAY_BUFFER) {
+		while (replay->full) {
+			pthread_cond_wait(&replay->written, &replay->lock);
+		}
+		internal_replay_swap(replay);
+	}
+	memcpy(replay->buffers[replay->active] + replay->used[replay->active], bytes, count);
+	replay->used[replay->active] += count;
+	pthread_mutex_unlock(&replay->lock);
+}
+
+void internal_replay_event(Replay *replay, int64_t tick, ReplayEvent event)
+{
+	unsigned char bytes[10];
+	uint64_t delta = tick > replay->tick ? tick - replay->tick : 0;
+	replay->tick += delta;
+	internal_replay_append(replay, bytes, replay_varint_write(bytes, (delta << 3) | event));
+}
+
+Replay *replay_create(const char *path, const ReplayHeader *header)
+{
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		fprintf(stderr, "Failed to create the replay '%s': %s\n", path, strerror(errno));
+		return NULL;
+	}
+
+	Replay *replay = calloc(1, sizeof(*replay));
+	replay->file = file;
+	replay->buffers[0] = malloc(REPLAY_BUFFER);
+	replay->buffers[1] = malloc(REPLAY_BUFFER);
+	pthread_mutex_init(&replay->lock, NULL);
+	pthread_cond_init(&replay->wake, NULL);
+	pthread_cond_init(&replay->written, NULL);
+
+	unsigned char bytes[5 + 6 * 10];
+	memcpy(bytes, REPLAY_MAGIC, 4);
+	bytes[4] = REPLAY_VERSION;
+	int count = 5;
+	count += replay_varint_write(bytes + count, header->seed);
+	count += replay_varint_write(bytes + count, header->width);
+	count += replay_varint_write(bytes + count, header->height);
+	count += replay_varint_write(bytes + count, header->start_x);
+	count += replay_varint_write(bytes + count, header->start_y);
+	count += replay_varint_write(bytes + count, header->flags);
+	internal_replay_append(replay, bytes, count);
+
+	int error = pthread_create(&replay->thread, NULL, internal_replay_flush, replay);
+	if (error) {
+		fprintf(stderr, "Failed to start the writer of the replay '%s': %s\n", path, strerror(error));
+		fclose(file);
+		remove(path);
+		pthread_cond_destroy(&replay->written);
+		pthread_cond_destroy(&replay->wake);
+		pthread_mutex_destroy(&replay->lock);
+		free(replay->buffers[0]);
+		free(replay->buffers[1]);
+		free(replay);
+		return NULL;
+	}
+	return replay;
+}
+
+void replay_turn(Replay *replay, int64_t tick, GameSnakeDirection direction)
+{
+	if (direction >= GSD_DOWN && direction <= GSD_LEFT) {
+		internal_replay_event(replay, tick, (ReplayEvent)direction);
+	}
+}
+
+void replay_lost(Replay *replay, int64_t tick)
+{
+	internal_replay_event(replay, tick, REPLAY_LOST);
+}
+
+void replay_destroy(Replay *replay, int64_t tick)
+{
+	internal_replay_event(replay, tick, REPLAY_END);
+
+	pthread_mutex_lock(&replay->lock);
+	replay->stop = 1;
+	pthread_cond_signal(&replay->wake);
+	pthread_mutex_unlock(&replay->lock);
+	pthread_join(replay->thread, NULL);
+
+	fclose(replay->file);
+	pthread_cond_destroy(&replay->written);
+	pthread_cond_destroy(&replay->wake);
+	pthread_mutex_destroy(&replay->lock);
+	free(replay->buffers[0]);
+	free(replay->buffers[1]);
+	free(replay);
+}
+
+int replay_header_read(const void *data, size_t size, ReplayHeader *header)
+{
+	const unsigned char *p = data, *end = p + size;
+	if (size < 5 || memcmp(p, REPLAY_MAGIC, 4) || p[4] != REPLAY_VERSION) {
+		return 0;
+	}
+	p += 5;
+
+	uint64_t fields[6];
+	for (int i = 0; i < 6; ++i) {
+		int n = replay_varint_read(p, end, &fields[i]);
+		if (!n || (i > 0 && fields[i] > INT32_MAX)) {
+			return 0;
+		}
+		p += n;
+	}
+	header->seed = fields[0];
+	header->width = fields[1];
+	header->height = fields[2];
+	header->start_x = fields[3];
+	header->start_y = fields[4];
+	header->flags = fields[5];
+
+	if (header->width < 1 || header->height < 1 || header->flags & ~(GAME_COMPACT_BODY | GAME_CHUNKED)) {
+		return 0;
+	}
+	if (!(header->flags & GAME_CHUNKED) && (int64_t)header->width * header->height > REPLAY_MAX_CELLS) {
+		return 0;
+	}
+	if ((header->flags & GAME_CHUNKED) && (header->width > REPLAY_MAX_CHUNKED_SIDE || header->height > REPLAY_MAX_CHUNKED_SIDE)) {
+		return 0;
+	}
+	if (header->start_x >= header->width || header->start_y >= header->height) {
+		return 0;
+	}
+	return p - (const unsigned char *)data;
+}
+
+/* Runs updates until the game reaches 'tick'. Returns 1 if one of them lost the game. */
+int internal_replay_advance(GameContext *game, int64_t tick)
+{
+	return game_ticks(game) < tick && game_advance(game, tick - game_ticks(game));
+}
+
+void internal_replay_score(GameContext *game, ReplayResult *result)
+{
+	result->score = game_snake_length(game) - 2;
+	if (result->score > result->best) {
+		result->best = result->score;
+	}
+}
+
+void replay_run(const void *data, size_t size, int64_t max_ticks, ReplayResult *result)
+{
+	memset(result, 0, sizeof(*result));
+
+	ReplayHeader header;
+	int header_size = replay_header_read(data, size, &header);
+	if (!header_size) {
+		result->error = "bad header";
+		return;
+	}
+
+	GameContext *game = game_create_ex(header.width, header.height, header.seed, header.flags);
+	game_start(game, header.start_x, header.start_y);
+	result->episodes = 1;
+
+	const unsigned char *p = (const unsigned char *)data + header_size, *end = (const unsigned char *)data + size;
+	int64_t tick = 0;
+	while (!result->error) {
+		uint64_t value;
+		int n = replay_varint_read(p, end, &value);
+		if (!n) {
+			result->error = "cut off";
+			break;
+		}
+		p += n;
+
+		uint64_t delta = value >> 3;
+		if (delta > (uint64_t)(max_ticks - tick)) {
+			result->error = "too long";
+			break;
+		}
+		tick += delta;
+
+		ReplayEvent event = value & 7;
+		if (event == REPLAY_LOST) {
+			if (delta == 0 || internal_replay_advance(game, tick - 1)) {
+				result->error = "lost without a record";
+			} else if (!game_update(game)) {
+				result->error = "recorded loss did not happen";
+			} else {
+				internal_replay_score(game, result);
+				game_start(game, header.start_x, header.start_y);
+				result->episodes++;
+			}
+		} else if (event >= (ReplayEvent)GSD_DOWN && event <= (ReplayEvent)GSD_LEFT) {
+			if (internal_replay_advance(game, tick)) {
+				result->error = "lost without a record";
+			} else if (!game_set_snake_direction(game, (GameSnakeDirection)event)) {
+				result->error = "turn refused";
+			}
+		} else if (event == REPLAY_END) {
+			if (internal_replay_advance(game, tick)) {
+				result->error = "lost without a record";
+			} else if (p != end) {
+				result->error = "data after the end";
+			} else {
+				internal_replay_score(game, result);
+				result->valid = 1;
+			}
+			break;
+		} else {
+			result->error = "unknown event";
+		}
+	}
+
+	result->ticks = game_ticks(game);
+	game_destroy(game);
+}
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ROLLOUT_INTERNAL
+#include "rollout.h"
+
+#define ROLLOUT_SLICE 64 /* Steps a shard takes before it is requeued in free running mode */
+
+void internal_rollout_count(RolloutShard *shard, const float *rewards, const unsigned char *dones)
+{
+	shard->steps += shard->count;
+	for (int i = 0; i < shard->count; ++i) {
+		shard->episodes += dones[i];
+		shard->food += rewards[i] > 0;
+	}
+}
+
+void internal_rollout_step(void *arg, int worker)
+{
+	(void)worker;
+	RolloutShard *shard = arg;
+	game_batch_step(shard->batch, &shard->step_actions[shard->first], &shard->step_rewards[shard->first], &shard->step_dones[shard->first]);
+	internal_rollout_count(shard, &shard->step_rewards[shard->first], &shard->step_dones[shard->first]);
+}
+
+void internal_rollout_run(void *arg, int worker)
+{
+	RolloutShard *shard = arg;
+	Rollout *r = shard->rollout;
+
+	int slice = shard->remaining < ROLLOUT_SLICE ? shard->remaining : ROLLOUT_SLICE;
+	for (int s = 0; s < slice; ++s) {
+		r->policy(r->policy_context, shard->first, shard->count, &shard->random, shard->actions);
+		game_batch_step(shard->batch, shard->actions, shard->rewards, shard->dones);
+		internal_rollout_count(shard, shard->rewards, shard->dones);
+	}
+
+	shard->remaining -= slice;
+	if (shard->remaining > 0) {
+		scheduler_submit_to(r->scheduler, worker, internal_rollout_run, shard);
+	}
+}
+
+Rollout *rollout_create(Scheduler *s, int games, int width, int height, int shard_games, uint64_t seed)
+{
+	Rollout *r = calloc(1, sizeof(*r));
+	r->scheduler = s;
+	r->games = games;
+	r->shard_count = (games + shard_games - 1) / shard_games;
+	r->shards = calloc(r->shard_count, sizeof(*r->shards));
+
+	for (int i = 0; i < r->shard_count; ++i) {
+		RolloutShard *shard = &r->shards[i];
+		shard->rollout = r;
+		shard->first = i * shard_games;
+		shard->count = games - shard->first < shard_games ? games - shard->first : shard_games;
+		shard->home = i % scheduler_workers(s);
+		shard->batch = game_batch_create(shard->count, width, height, seed + shard->first);
+		random_seed(&shard->random, ~seed + shard->first);
+		shard->actions = malloc(shard->count * sizeof(*shard->actions));
+		shard->rewards = malloc(shard->count * sizeof(*shard->rewards));
+		shard->dones = malloc(shard->count);
+	}
+
+	return r;
+}
+
+void rollout_step(Rollout *r, const GameSnakeDirection *actions, float *rewards, unsigned char *dones)
+{
+	for (int i = 0; i < r->shard_count; ++i) {
+		RolloutShard *shard = &r->shards[i];
+		shard->step_actions = actions;
+		shard->step_rewards = rewards;
+		shard->step_dones = dones;
+		scheduler_submit_to(r->scheduler, shard->home, internal_rollout_step, shard);
+	}
+	scheduler_wait(r->scheduler);
+}
+
+void rollout_run(Rollout *r, int steps, RolloutPolicy policy, void *context)
+{
+	r->policy = policy;
+	r->policy_context = context;
+	for (int i = 0; i < r->shard_count; ++i) {
+		r->shards[i].remaining = steps;
+		if (steps > 0) {
+			scheduler_submit_to(r->scheduler, r->shards[i].home, internal_rollout_run, &r->shards[i]);
+		}
+	}
+	scheduler_wait(r->scheduler);
+}
+
+void rollout_stats(Rollout *r, RolloutStats *stats)
+{
+	stats->steps = 0;
+	stats->episodes = 0;
+	stats->food = 0;
+	for (int i = 0; i < r->shard_count; ++i) {
+		stats->steps += r->shards[i].steps;
+		stats->episodes += r->shards[i].episodes;
+		stats->food += r->shards[i].food;
+	}
+}
+
+void rollout_destroy(Rollout *r)
+{
+	for (int i = 0; i < r->shard_count; ++i) {
+		game_batch_destroy(r->shards[i].batch);
+		free(r->shards[i].actions);
+		free(r->shards[i].rewards);
+		free(r->shards[i].dones);
+	}
+	free(r->shards);
+	free(r);
+}
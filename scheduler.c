@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define SCHEDULER_INTERNAL
+#include "scheduler.h"
+
+typedef struct {
+	Scheduler *s;
+	int worker;
+} SchedulerWorker;
+
+void internal_deque_push(SchedulerDeque *d, SchedulerJob job)
+{
+	pthread_mutex_lock(&d->lock);
+	if (d->bottom - d->top == d->capacity) {
+		SchedulerJob *jobs = malloc(2 * d->capacity * sizeof(*jobs));
+		for (int i = d->top; i < d->bottom; ++i) {
+			jobs[i & (2 * d->capacity - 1)] = d->jobs[i & (d->capacity - 1)];
+		}
+		free(d->jobs);
+		d->jobs = jobs;
+		d->capacity *= 2;
+	}
+	d->jobs[d->bottom++ & (d->capacity - 1)] = job;
+	pthread_mutex_unlock(&d->lock);
+}
+
+/* Takes the most recently pushed job. Returns 0 if the deque is empty. */
+int internal_deque_pop(SchedulerDeque *d, SchedulerJob *job)
+{
+	int found = 0;
+	pthread_mutex_lock(&d->lock);
+	if (d->bottom > d->top) {
+		*job = d->jobs[--d->bottom & (d->capacity - 1)];
+		found = 1;
+	}
+	pthread_mutex_unlock(&d->lock);
+	return found;
+}
+
+/* Takes the oldest job. Returns 0 if the deque is empty. */
+int internal_deque_steal(SchedulerDeque *d, SchedulerJob *job)
+{
+	int found = 0;
+	pthread_mutex_lock(&d->lock);
+	if (d->bottom > d->top) {
+		*job = d->jobs[d->top++ & (d->capacity - 1)];
+		found = 1;
+	}
+	pthread_mutex_unlock(&d->lock);
+	return found;
+}
+
+int internal_scheduler_take(Scheduler *s, int worker, SchedulerJob *job)
+{
+	if (internal_deque_pop(&s->deques[worker], job)) {
+		return 1;
+	}
+	for (int i = 1; i < s->workers; ++i) {
+		if (internal_deque_steal(&s->deques[(worker + i) % s->workers], job)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void *internal_scheduler_worker(void *arg)
+{
+	Scheduler *s = ((SchedulerWorker *)arg)->s;
+	int worker = ((SchedulerWorker *)arg)->worker;
+	free(arg);
+
+	for (;;) {
+		SchedulerJob job;
+		if (atomic_load(&s->queued) > 0 && internal_scheduler_take(s, worker, &job)) {
+			atomic_fetch_sub(&s->queued, 1);
+			job.task(job.arg, worker);
+			if (atomic_fetch_sub(&s->pending, 1) == 1) {
+				pthread_mutex_lock(&s->lock);
+				pthread_cond_broadcast(&s->done);
+				pthread_mutex_unlock(&s->lock);
+			}
+			continue;
+		}
+
+		pthread_mutex_lock(&s->lock);
+		while (atomic_load(&s->queued) == 0 && !s->stop) {
+			s->sleeping++;
+			pthread_cond_wait(&s->wake, &s->lock);
+			s->sleeping--;
+		}
+		int stop = s->stop && atomic_load(&s->queued) == 0;
+		pthread_mutex_unlock(&s->lock);
+		if (stop) {
+			return NULL;
+		}
+	}
+}
+
+Scheduler *scheduler_create(int workers)
+{
+	if (workers <= 0) {
+		workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		if (workers <= 0) workers = 1;
+	}
+
+	Scheduler *s = calloc(1, sizeof(*s));
+	s->workers = workers;
+	s->threads = malloc(workers * sizeof(*s->threads));
+	s->deques = calloc(workers, sizeof(*s->deques));
+	atomic_init(&s->queued, 0);
+	atomic_init(&s->pending, 0);
+	atomic_init(&s->next, 0);
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->wake, NULL);
+	pthread_cond_init(&s->done, NULL);
+
+	for (int i = 0; i < workers; ++i) {
+		pthread_mutex_init(&s->deques[i].lock, NULL);
+		s->deques[i].capacity = 64;
+		s->deques[i].jobs = malloc(s->deques[i].capacity * sizeof(*s->deques[i].jobs));
+	}
+
+	for (int i = 0; i < workers; ++i) {
+		SchedulerWorker *arg = malloc(sizeof(*arg));
+		arg->s = s;
+		arg->worker = i;
+		if (pthread_create(&s->threads[i], NULL, internal_scheduler_worker, arg)) {
+			fprintf(stderr, "Failed to start scheduler worker %d.\n", i);
+			exit(-1);
+		}
+	}
+
+	return s;
+}
+
+int scheduler_workers(Scheduler *s)
+{
+	return s->workers;
+}
+
+void scheduler_submit(Scheduler *s, SchedulerTask task, void *arg)
+{
+	scheduler_submit_to(s, atomic_fetch_add(&s->next, 1) % s->workers, task, arg);
+}
+
+void scheduler_submit_to(Scheduler *s, int worker, SchedulerTask task, void *arg)
+{
+	SchedulerJob job = { task, arg };
+	atomic_fetch_add(&s->pending, 1);
+	internal_deque_push(&s->deques[worker], job);
+	atomic_fetch_add(&s->queued, 1);
+
+	pthread_mutex_lock(&s->lock);
+	if (s->sleeping > 0) {
+		pthread_cond_signal(&s->wake);
+	}
+	pthread_mutex_unlock(&s->lock);
+}
+
+void scheduler_wait(Scheduler *s)
+{
+	pthread_mutex_lock(&s->lock);
+	while (atomic_load(&s->pending) > 0) {
+		pthread_cond_wait(&s->done, &s->lock);
+	}
+	pthread_mutex_unlock(&s->lock);
+}
+
+void scheduler_destroy(Scheduler *s)
+{
+	pthread_mutex_lock(&s->lock);
+	s->stop = 1;
+	pthread_cond_broadcast(&s->wake);
+	pthread_mutex_unlock(&s->lock);
+
+	for (int i = 0; i < s->workers; ++i) {
+		pthread_join(s->threads[i], NULL);
+		pthread_mutex_destroy(&s->deques[i].lock);
+		free(s->deques[i].jobs);
+	}
+
+	pthread_cond_destroy(&s->done);
+	pthread_cond_destroy(&s->wake);
+	pthread_mutex_destroy(&s->lock);
+	free(s->deques);
+	free(s->threads);
+	free(s);
+}
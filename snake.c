@@ -7,19 +7,23 @@
 #include <string.h>
 #include <time.h>
 
+#include "autopilot.h"
 #include "collections.h"
 #include "render.h"
 #include "game.h"
+#include "replay.h"
 
 #define INPUT_DOWN  GLFW_KEY_DOWN
 #define INPUT_UP    GLFW_KEY_UP
 #define INPUT_LEFT  GLFW_KEY_LEFT
 #define INPUT_RIGHT GLFW_KEY_RIGHT
+#define INPUT_AUTOPILOT GLFW_KEY_A /* Hands the snake to the autopilot and back */
 
 #define WINDOW_WIDTH    600
 #define WINDOW_HEIGHT   600
 #define GRID_SIZE       15
-#define UPDATE_INTERVAL 8
+#define TICK_RATE       7.5 /* Game updates per second */
+#define MAX_CATCHUP     4   /* Most updates run in one frame after a stall */
 
 typedef struct Cell {
 	float vertices[8];
@@ -30,6 +34,34 @@ typedef struct {
 	RenderContext *render;
 } BufferCell_callback;
 
+/*
+ * Snake segments in the vertex buffer, in order from the tail and wrapping around the end.
+ * A tick then only writes the new head and clears the old tail.
+ */
+typedef struct SnakeRing {
+	RenderContext *render;
+	int front;    /* Slot of the tail */
+	int count;    /* Slots in use */
+	int capacity;
+} SnakeRing;
+
+/*
+ * Fixed timestep clock. Game updates run at TICK_RATE whatever the frame rate is.
+ */
+typedef struct Clock {
+	double tick;        /* Seconds per update */
+	double previous;    /* Time of the last clock_advance */
+	double accumulator; /* Time not yet consumed by updates */
+	double alpha;       /* How far the frame is between the last and the next update, in [0, 1) */
+} Clock;
+
+typedef struct {
+	GameContext *game;
+	Clock *clock;
+	Replay *replay; /* NULL if the session isn't recorded */
+	int autopilot_on; /* Turns come from the autopilot instead of the keys */
+} KeyInput_callback;
+
 const float COLOR_BG[3]    = { 0.2f, 0.2f, 0.2f };
 const float COLOR_SNAKE[3] = { 0.5f, 0.5f, 0.5f };
 const float COLOR_FOOD[3]  = { 0.1f, 0.7f, 0.1f };
@@ -106,39 +138,95 @@ void grid_write(RenderContext *line_render, int n) {
 	render_ctx_write(line_render, 0, 2 * (n - 1), vertices);
 }
 
+void clock_start(Clock *clock, double rate)
+{
+	clock->tick = 1.0 / rate;
+	clock->previous = glfwGetTime();
+	clock->accumulator = 0;
+	clock->alpha = 0;
+}
+
 /*
- * Processes the input.
+ * Returns the number of updates due since the last call. After a stall at most MAX_CATCHUP
+ * updates are returned and the rest of the backlog is dropped.
  */
-void input_process(GLFWwindow *window, GameContext *game, int *update_counter) {
-	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
-		glfwSetWindowShouldClose(window, 1);
-		return;
+int clock_advance(Clock *clock)
+{
+	double now = glfwGetTime();
+	clock->accumulator += now - clock->previous;
+	clock->previous = now;
+
+	int ticks = 0;
+	while (clock->accumulator >= clock->tick && ticks < MAX_CATCHUP) {
+		clock->accumulator -= clock->tick;
+		ticks++;
+	}
+	if (clock->accumulator >= clock->tick) {
+		clock->accumulator = fmod(clock->accumulator, clock->tick);
 	}
 
-	GameSnakeDirection direction = 0;
+	clock->alpha = clock->accumulator / clock->tick;
+	return ticks;
+}
+
+/*
+ * Makes the next clock_advance run an update and restarts the tick phase from there.
+ */
+void clock_force_tick(Clock *clock)
+{
+	clock->accumulator = clock->tick;
+}
 
-	if (glfwGetKey(window, INPUT_DOWN)) {
-		direction = GSD_DOWN;
+/*
+ * Processes the input that is polled every frame.
+ */
+void input_process(GLFWwindow *window) {
+	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
+		glfwSetWindowShouldClose(window, 1);
 	}
+}
 
-	if (glfwGetKey(window, INPUT_UP)) {
-		direction = GSD_UP;
+/*
+ * Queues turns as keys are pressed, so several presses within one update are all kept.
+ */
+void callback_key(GLFWwindow *window, int key, int scancode, int action, int mods)
+{
+	(void)scancode;
+	(void)mods;
+	if (action != GLFW_PRESS) {
+		return;
 	}
 
-	if (glfwGetKey(window, INPUT_RIGHT)) {
-		direction = GSD_RIGHT;
+	KeyInput_callback *instance = glfwGetWindowUserPointer(window);
+	if (key == INPUT_AUTOPILOT) {
+		instance->autopilot_on = !instance->autopilot_on;
+		return;
+	}
+	if (instance->autopilot_on) {
+		return;
 	}
 
-	if (glfwGetKey(window, INPUT_LEFT)) {
-		direction = GSD_LEFT;
+	GameSnakeDirection direction = GSD_NONE;
+	switch (key) {
+		case INPUT_DOWN:  direction = GSD_DOWN;  break;
+		case INPUT_UP:    direction = GSD_UP;    break;
+		case INPUT_RIGHT: direction = GSD_RIGHT; break;
+		case INPUT_LEFT:  direction = GSD_LEFT;  break;
 	}
 
 	if (!direction) {
 		return;
 	}
 
-	if (game_set_snake_direction(game, direction) && (*update_counter < (UPDATE_INTERVAL / 3))) {
-		*update_counter = 0;
+	if (!game_set_snake_direction(instance->game, direction)) {
+		return;
+	}
+	if (instance->replay) {
+		replay_turn(instance->replay, game_ticks(instance->game), direction);
+	}
+	/* A turn right after an update is applied at once instead of waiting for the next one. */
+	if (instance->clock->accumulator < instance->clock->tick / 3) {
+		clock_force_tick(instance->clock);
 	}
 }
 
@@ -155,31 +243,93 @@ void callback_buffer_cell(void *xy, void *callback_BufferCell_instance)
 	instance->offset++;
 }
 
-void render_loop(GLFWwindow *window, GameContext *game, RenderContext *render_line, RenderContext *render_snake, RenderContext *render_food, GLuint uniform_color)
+/*
+ * Writes the whole snake again. Used when a game starts.
+ */
+void snake_ring_rebuild(SnakeRing *ring, GameContext *game)
+{
+	render_ctx_clear(ring->render);
+	BufferCell_callback fbcc = { 0, ring->render };
+	game_callback_context_set(game, &fbcc);
+	game_snake_foreach(game, callback_buffer_cell);
+	render_ctx_update(ring->render);
+	ring->front = 0;
+	ring->count = fbcc.offset;
+}
+
+/*
+ * Applies the changes of one update: at most one slot is cleared and one written.
+ */
+void snake_ring_apply(SnakeRing *ring, const GameDelta *delta)
+{
+	if (delta->tail_removed) {
+		Cell empty = { { 0 } };
+		render_ctx_write(ring->render, ring->front, 1, empty.vertices);
+		render_ctx_update_range(ring->render, ring->front, 1);
+		ring->front = (ring->front + 1) % ring->capacity;
+		ring->count--;
+	}
+	if (delta->moved) {
+		int slot = (ring->front + ring->count) % ring->capacity;
+		Cell head = cell_create(GRID_SIZE, delta->head_x, delta->head_y);
+		render_ctx_write(ring->render, slot, 1, head.vertices);
+		render_ctx_update_range(ring->render, slot, 1);
+		ring->count++;
+	}
+}
+
+void food_write(RenderContext *render_food, GameContext *game)
+{
+	int foodxy[2];
+	game_get_food(game, foodxy);
+	Cell food = cell_create(GRID_SIZE, foodxy[0], foodxy[1]);
+	render_ctx_write(render_food, 0, 1, food.vertices);
+	render_ctx_update(render_food);
+}
+
+void render_loop(GLFWwindow *window, GameContext *game, Replay *replay, Autopilot *autopilot, int autopilot_on, RenderContext *render_line, RenderContext *render_snake, RenderContext *render_food, GLuint uniform_color)
 {
 	game_start(game, GRID_SIZE / 2, GRID_SIZE / 2);
 
 	grid_write(render_line, GRID_SIZE);
 	render_ctx_update(render_line);
 
-	int frame = 0;
+	Clock clock;
+	clock_start(&clock, TICK_RATE);
+	clock_force_tick(&clock);
+
+	KeyInput_callback keys = { game, &clock, replay, autopilot_on };
+	glfwSetWindowUserPointer(window, &keys);
+	glfwSetKeyCallback(window, callback_key);
+
+	SnakeRing ring = { render_snake, 0, 0, GRID_SIZE * GRID_SIZE };
+	snake_ring_rebuild(&ring, game);
+	food_write(render_food, game);
+
 	while (!glfwWindowShouldClose(window)) {
-		input_process(window, game, &frame);
-		if ((UPDATE_INTERVAL + frame++) % UPDATE_INTERVAL == 0) {
-			if (game_update(game)) { /* Restart the game */
-				render_ctx_clear(render_snake);
+		input_process(window);
+		int ticks = clock_advance(&clock);
+		for (int i = 0; i < ticks; ++i) {
+			if (keys.autopilot_on) {
+				GameSnakeDirection direction = autopilot_steer(autopilot, game);
+				if (direction && replay) {
+					replay_turn(replay, game_ticks(game), direction);
+				}
+			}
+			GameDelta delta;
+			if (game_update_ex(game, &delta)) { /* Restart the game */
+				if (replay) {
+					replay_lost(replay, game_ticks(game));
+				}
 				game_start(game, GRID_SIZE / 2, GRID_SIZE / 2);
-			};
-			BufferCell_callback fbcc = { 0, render_snake };
-			game_callback_context_set(game, &fbcc);
-			game_snake_foreach(game, callback_buffer_cell);
-			render_ctx_update(render_snake);
-
-			int foodxy[2];
-			game_get_food(game, foodxy);
-			Cell food = cell_create(GRID_SIZE, foodxy[0], foodxy[1]);
-			render_ctx_write(render_food, 0, 1, food.vertices);
-			render_ctx_update(render_food);
+				snake_ring_rebuild(&ring, game);
+				food_write(render_food, game);
+				continue;
+			}
+			snake_ring_apply(&ring, &delta);
+			if (delta.food_moved) {
+				food_write(render_food, game);
+			}
 		}
 
 		glClearColor(COLOR_BG[0], COLOR_BG[1], COLOR_BG[2], 1);
@@ -197,8 +347,21 @@ void render_loop(GLFWwindow *window, GameContext *game, RenderContext *render_li
 	}
 }
 
-int main(void)
+int main(int argc, char **argv)
 {
+	const char *record_path = NULL;
+	int autopilot_on = 0;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+			record_path = argv[++i];
+		} else if (!strcmp(argv[i], "--autopilot")) {
+			autopilot_on = 1;
+		} else {
+			fprintf(stderr, "Usage: %s [--record FILE] [--autopilot]\n", argv[0]);
+			return -1;
+		}
+	}
+
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -226,19 +389,38 @@ int main(void)
 	}
 	glUseProgram(program);
 
-	GameContext   *game         = game_create(GRID_SIZE, GRID_SIZE);
+	uint64_t seed = time(NULL);
+	GameContext   *game         = game_create(GRID_SIZE, GRID_SIZE, seed);
 	RenderContext *render_line  = render_ctx_line(2 * GRID_SIZE);
 	RenderContext *render_snake = render_ctx_square(GRID_SIZE * GRID_SIZE);
 	RenderContext *render_food  = render_ctx_square(1);
+	Autopilot     *autopilot    = autopilot_create(GRID_SIZE, GRID_SIZE);
+
+	Replay *replay = NULL;
+	if (record_path) {
+		ReplayHeader header = { seed, GRID_SIZE, GRID_SIZE, GRID_SIZE / 2, GRID_SIZE / 2, 0 };
+		replay = replay_create(record_path, &header);
+	}
 
-	srand(time(NULL));
-	render_loop(window, game, render_line, render_snake, render_food, glGetUniformLocation(program, "color"));
+	render_loop(window, game, replay, autopilot, autopilot_on, render_line, render_snake, render_food, glGetUniformLocation(program, "color"));
+
+	if (replay) {
+		replay_destroy(replay, game_ticks(game));
+	}
 
 	render_ctx_destroy(render_snake);
 	render_ctx_destroy(render_food);
 	render_ctx_destroy(render_line);
 	game_destroy(game);
 
+	AutopilotStats stats;
+	autopilot_stats(autopilot, &stats);
+	if (stats.decisions) {
+		printf("autopilot: %lld decisions, %.0f decisions/s, average plan %.1f moves, %lld without a safe path\n",
+			(long long)stats.decisions, stats.decisions_per_second, stats.average_plan, (long long)stats.fallbacks);
+	}
+	autopilot_destroy(autopilot);
+
 	glfwTerminate();
 	return 0;
 }
@@ -0,0 +1,152 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "game.h"
+#include "random.h"
+
+/*
+ * Differential test of GameBatch against GameContext. A batch and one game per lane are created
+ * with the same seeds and given the same turns, and after every step the rewards, dones and
+ * full observations must agree. Every kernel the cpu and the board size support is checked, on
+ * square, non square and wider than 32 boards. The lane count is not a multiple of 8 so the
+ * vector kernels run their tail too.
+ */
+
+#define TEST_GAMES 13
+#define TEST_STEPS 3000
+
+/* Mostly keeps the snake alive, sometimes turns at random so games are lost and restarted. */
+GameSnakeDirection test_turn(GameContext *game, Random *random)
+{
+	const int dx[] = { 0, 0, 0, 1, -1 };
+	const int dy[] = { 0, -1, 1, 0, 0 };
+	int head[2], move[2];
+	game_get_head(game, head);
+	game_get_move(game, move);
+	if (random_bounded(random, 64) == 0) {
+		return (GameSnakeDirection)(1 + random_bounded(random, 4));
+	}
+	int ahead = (move[0] || move[1]) && !game_is_blocked(game, head[0] + move[0], head[1] + move[1]);
+	if (ahead && random_bounded(random, 4)) {
+		return GSD_NONE;
+	}
+
+	int first = random_bounded(random, 4);
+	for (int i = 0; i < 4; ++i) {
+		int d = 1 + (first + i) % 4;
+		int along = (dx[d] && move[0]) || (dy[d] && move[1]);
+		if (!along && !game_is_blocked(game, head[0] + dx[d], head[1] + dy[d])) {
+			return (GameSnakeDirection)d;
+		}
+	}
+	return GSD_NONE;
+}
+
+int test_batch(int width, int height, GameBatchKernel kernel, const char *name)
+{
+	const uint64_t seed = 1000;
+	GameBatch *batch = game_batch_create(TEST_GAMES, width, height, seed);
+	if (!game_batch_kernel_set(batch, kernel)) {
+		game_batch_destroy(batch);
+		return 0;
+	}
+
+	GameContext *games[TEST_GAMES];
+	GameObserveLayout layouts[TEST_GAMES];
+	memset(layouts, 0, sizeof(layouts));
+	for (int i = 0; i < TEST_GAMES; ++i) {
+		games[i] = game_create(width, height, seed + i);
+		game_start(games[i], width / 2, height / 2);
+	}
+
+	size_t size = game_observe_size(games[0], &layouts[0]);
+	unsigned char *expected = malloc(size * TEST_GAMES);
+	unsigned char *batched = malloc(size * TEST_GAMES);
+	GameSnakeDirection actions[TEST_GAMES];
+	float rewards[TEST_GAMES];
+	unsigned char dones[TEST_GAMES];
+	Random random;
+	random_seed(&random, seed);
+
+	int failed = 0, restarts = 0;
+	for (int step = 0; step < TEST_STEPS && !failed; ++step) {
+		for (int i = 0; i < TEST_GAMES; ++i) {
+			actions[i] = test_turn(games[i], &random);
+		}
+		game_batch_step(batch, actions, rewards, dones);
+
+		for (int i = 0; i < TEST_GAMES && !failed; ++i) {
+			int length = game_snake_length(games[i]);
+			if (actions[i]) game_set_snake_direction(games[i], actions[i]);
+			int lost = game_update(games[i]);
+			float reward = lost ? -1.0f : game_snake_length(games[i]) > length ? 1.0f : 0.0f;
+			if (lost) {
+				game_start(games[i], width / 2, height / 2);
+				restarts++;
+			}
+			if (dones[i] != lost || rewards[i] != reward) {
+				printf("%s, step %d, game %d: batch gave reward %g done %d, the game %g %d\n",
+					name, step, i, rewards[i], dones[i], reward, lost);
+				failed = 1;
+			}
+
+			GameObserveLayout full = layouts[i];
+			game_observe(games[i], &full, expected + i * size);
+		}
+
+		for (int i = 0; i < TEST_GAMES; ++i) {
+			layouts[i].written = 0;
+		}
+		game_batch_observe(batch, layouts, batched);
+		for (int i = 0; i < TEST_GAMES && !failed; ++i) {
+			if (memcmp(batched + i * size, expected + i * size, size)) {
+				printf("%s, step %d, game %d: batch observation differs from the game\n", name, step, i);
+				failed = 1;
+			}
+		}
+	}
+	if (!failed && !restarts) {
+		printf("%s: no game was lost, restarts are not covered\n", name);
+		failed = 1;
+	}
+
+	for (int i = 0; i < TEST_GAMES; ++i) {
+		game_destroy(games[i]);
+	}
+	game_batch_destroy(batch);
+	free(expected);
+	free(batched);
+	return failed;
+}
+
+int main(void)
+{
+	const struct {
+		int width, height;
+	} sizes[] = {
+		{ 8, 8 }, { 15, 15 }, { 16, 16 }, { 32, 32 }, { 15, 11 }, { 7, 23 }, { 40, 12 }, { 70, 9 }, { 130, 5 },
+	};
+	const struct {
+		GameBatchKernel kernel;
+		const char *name;
+	} kernels[] = {
+		{ GBK_SCALAR, "scalar" },
+		{ GBK_AVX2, "avx2" },
+		{ GBK_SCALAR_FIXED, "scalar fixed" },
+		{ GBK_AVX2_FIXED, "avx2 fixed" },
+	};
+
+	int failures = 0;
+	for (unsigned s = 0; s < sizeof(sizes) / sizeof(*sizes); ++s) {
+		for (unsigned k = 0; k < sizeof(kernels) / sizeof(*kernels); ++k) {
+			char name[64];
+			snprintf(name, sizeof(name), "%dx%d %s", sizes[s].width, sizes[s].height, kernels[k].name);
+			failures += test_batch(sizes[s].width, sizes[s].height, kernels[k].kernel, name);
+		}
+	}
+
+	printf("batch: %s\n", failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define GAME_INTERNAL
+#include "game.h"
+#include "level.h"
+#include "random.h"
+
+/*
+ * Checks the state games keep up to date incrementally against a recomputation from scratch
+ * after every random step: the layout of the free set with its holes, see game_rules.h, and
+ * the Zobrist hash.
+ */
+
+#define TEST_STEPS 20000
+#define TEST_HASH_BODY 0 /* HASH_BODY in game.c */
+
+uint64_t internal_hash_key(int kind, int64_t index);
+uint64_t internal_hash_direction(int move_x, int move_y);
+uint64_t internal_hash_head(GameContext *game);
+uint64_t internal_hash_food(GameContext *game);
+
+typedef struct {
+	GameContext *game;
+	uint64_t hash;
+} TestBody_callback;
+
+void test_body(void *xy, void *context)
+{
+	TestBody_callback *instance = context;
+	instance->hash ^= internal_hash_key(TEST_HASH_BODY, (int64_t)((int *)xy)[1] * instance->game->width + ((int *)xy)[0]);
+}
+
+int test_key_free(GameContext *game, int key)
+{
+	int cell = game->open_cells ? game->open_cells[key] : key;
+	return !game_is_blocked(game, cell % game->width, cell / game->width);
+}
+
+/* Returns 0 if the free set and the hash agree with the body, prints the first difference otherwise. */
+int test_check(GameContext *game, const char *name, int step)
+{
+	int n = game->free_count;
+	int free_keys = 0, holes = 0, held_high = 0;
+	const char *what = NULL;
+	for (int key = 0; key < game->free_total && !what; ++key) {
+		int held = game->free_cells[key];
+		free_keys += test_key_free(game, key);
+		if (key >= n) {
+			if (held != key) what = "a slot from free_count on does not hold its own key";
+		} else if (test_key_free(game, key)) {
+			if (held != key) what = "a free key below free_count is not in its own slot";
+		} else {
+			holes++;
+			if (held < n || held >= game->free_total || !test_key_free(game, held)) what = "a hole does not hold a free key from free_count on";
+			else if (game->free_index[held] != key) what = "free_index does not point at the hole of its key";
+		}
+	}
+	for (int key = n; key < game->free_total && !what; ++key) {
+		held_high += test_key_free(game, key);
+	}
+	if (!what && free_keys != n) what = "free_count is not the number of free keys";
+	if (!what && held_high != holes) what = "free keys from free_count on are not all in holes";
+
+	TestBody_callback body = { game, internal_hash_direction(game->move_x, game->move_y) ^ internal_hash_head(game) ^ internal_hash_food(game) };
+	game_body_foreach(game, test_body, &body);
+	if (!what && body.hash != game_hash(game)) what = "the hash differs from a recomputation";
+
+	if (what) {
+		printf("%s, step %d: %s\n", name, step, what);
+		return 1;
+	}
+	return 0;
+}
+
+int test_game(GameContext *game, int start_x, int start_y, uint64_t seed, const char *name)
+{
+	Random random;
+	random_seed(&random, seed);
+	game_start(game, start_x, start_y);
+
+	int failed = test_check(game, name, 0);
+	for (int step = 1; step <= TEST_STEPS && !failed; ++step) {
+		uint32_t r = random_next(&random);
+		int head[2], move[2];
+		game_get_head(game, head);
+		game_get_move(game, move);
+		if ((r & 3) == 0 || game_is_blocked(game, head[0] + move[0], head[1] + move[1])) {
+			game_set_snake_direction(game, (GameSnakeDirection)(1 + ((r >> 2) & 3)));
+		}
+		int lost = (r & (15 << 4)) == 0 ? game_advance(game, 1 + ((r >> 8) & 7)) : game_update(game);
+		if (lost) {
+			game_start(game, start_x, start_y);
+		}
+		failed = test_check(game, name, step);
+	}
+
+	game_destroy(game);
+	return failed;
+}
+
+int main(void)
+{
+	int failures = 0;
+	failures += test_game(game_create_ex(15, 11, 1, 0), 7, 5, 1, "15x11");
+	failures += test_game(game_create_ex(6, 5, 2, 0), 3, 2, 2, "6x5");
+	failures += test_game(game_create_ex(70, 9, 3, GAME_COMPACT_BODY), 35, 4, 3, "70x9 compact");
+
+	/* Level games number the free set by the open cells only. */
+	char path[] = "/tmp/hash_test_XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		printf("hash: could not create a level file\n");
+		return 1;
+	}
+	close(fd);
+	unsigned char walls[12 * 9] = { 0 };
+	for (int i = 0; i < 12 * 9; i += 7) {
+		walls[i] = 1;
+	}
+	walls[4 * 12 + 6] = 0;
+	Level *level = level_write(path, 12, 9, 6, 4, walls, 0) ? NULL : level_open(path);
+	unlink(path);
+	if (!level) {
+		printf("hash: could not write the level\n");
+		return 1;
+	}
+	failures += test_game(game_create_level(level, 4, 0), 6, 4, 4, "12x9 level");
+	level_close(level);
+
+	printf("hash: %s\n", failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "game.h"
+#include "random.h"
+
+/*
+ * Checks that incremental observations give the same bytes as full writes, for games and for
+ * a batch stepped with the same seeds and turns. Turns avoid blocked cells whenever they can, so
+ * episodes run long enough for the u8 body values to wrap.
+ */
+
+#define TEST_GAMES 4
+#define TEST_STEPS 4000
+
+GameSnakeDirection test_turn(GameContext *game, Random *random)
+{
+	const int dx[] = { 0, 0, 0, 1, -1 };
+	const int dy[] = { 0, -1, 1, 0, 0 };
+	int head[2], move[2];
+	game_get_head(game, head);
+	game_get_move(game, move);
+	int ahead = (move[0] || move[1]) && !game_is_blocked(game, head[0] + move[0], head[1] + move[1]);
+	if (ahead && random_bounded(random, 4)) {
+		return GSD_NONE;
+	}
+
+	int first = random_bounded(random, 4);
+	for (int i = 0; i < 4; ++i) {
+		int d = 1 + (first + i) % 4;
+		int along = (dx[d] && move[0]) || (dy[d] && move[1]);
+		if (!along && !game_is_blocked(game, head[0] + dx[d], head[1] + dy[d])) {
+			return (GameSnakeDirection)d;
+		}
+	}
+	return GSD_NONE;
+}
+
+int test_observe(int width, int height, GameObserveType type, int padding, int flags, const char *name)
+{
+	GameBatch *batch = game_batch_create(TEST_GAMES, width, height, 100);
+	GameContext *games[TEST_GAMES];
+	GameObserveLayout layouts[TEST_GAMES], batch_layouts[TEST_GAMES];
+	for (int i = 0; i < TEST_GAMES; ++i) {
+		games[i] = game_create_ex(width, height, 100 + i, flags);
+		game_start(games[i], width / 2, height / 2);
+		memset(&layouts[i], 0, sizeof(layouts[i]));
+		layouts[i].type = type;
+		layouts[i].padding = padding;
+		batch_layouts[i] = layouts[i];
+	}
+
+	size_t size = game_observe_size(games[0], &layouts[0]);
+	unsigned char *incremental = malloc(size * TEST_GAMES);
+	unsigned char *batched = malloc(size * TEST_GAMES);
+	unsigned char *full = malloc(size);
+	GameSnakeDirection actions[TEST_GAMES];
+	float rewards[TEST_GAMES];
+	unsigned char dones[TEST_GAMES];
+	Random random;
+	random_seed(&random, 5);
+
+	int failed = 0;
+	for (int step = 0; step < TEST_STEPS && !failed; ++step) {
+		for (int i = 0; i < TEST_GAMES; ++i) {
+			actions[i] = test_turn(games[i], &random);
+		}
+		game_batch_step(batch, actions, rewards, dones);
+
+		for (int i = 0; i < TEST_GAMES && !failed; ++i) {
+			if (actions[i]) game_set_snake_direction(games[i], actions[i]);
+			if (game_update(games[i])) game_start(games[i], width / 2, height / 2);
+			game_observe(games[i], &layouts[i], incremental + i * size);
+
+			GameObserveLayout fresh = layouts[i];
+			fresh.written = 0;
+			game_observe(games[i], &fresh, full);
+			if (memcmp(full, incremental + i * size, size)) {
+				printf("%s, step %d, game %d: incremental observation differs from a full write\n", name, step, i);
+				failed = 1;
+			}
+		}
+
+		game_batch_observe(batch, batch_layouts, batched);
+		if (!failed && memcmp(batched, incremental, size * TEST_GAMES)) {
+			printf("%s, step %d: batch observation differs from the games\n", name, step);
+			failed = 1;
+		}
+	}
+
+	for (int i = 0; i < TEST_GAMES; ++i) {
+		game_destroy(games[i]);
+	}
+	game_batch_destroy(batch);
+	free(incremental);
+	free(batched);
+	free(full);
+	return failed;
+}
+
+int main(void)
+{
+	const struct {
+		int width, height;
+		GameObserveType type;
+		int padding;
+		int flags;
+		const char *name;
+	} cases[] = {
+		{ 15, 11, GAME_OBSERVE_U8, 0, 0, "15x11 u8" },
+		{ 15, 11, GAME_OBSERVE_U8, 2, GAME_COMPACT_BODY, "15x11 u8 padded compact" },
+		{ 15, 11, GAME_OBSERVE_F32, 0, GAME_COMPACT_BODY, "15x11 f32 compact" },
+		{ 15, 11, GAME_OBSERVE_F32, 2, 0, "15x11 f32 padded" },
+		{ 70, 9, GAME_OBSERVE_U8, 1, 0, "70x9 u8 padded" },
+	};
+
+	int failures = 0;
+	for (unsigned i = 0; i < sizeof(cases) / sizeof(*cases); ++i) {
+		failures += test_observe(cases[i].width, cases[i].height, cases[i].type, cases[i].padding, cases[i].flags, cases[i].name);
+	}
+
+	printf("observe: %s\n", failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "game.h"
+#include "random.h"
+
+/*
+ * Randomized differential test of the occupancy bitset. Games are driven with random and food
+ * seeking turns, fast forwards and snapshot restores, and after every change each cell of the map is looked up
+ * with game_is_blocked and compared against a walk over the body.
+ */
+
+#define TEST_STEPS 5000 /* Updates, fast forwards or restores per game */
+
+typedef struct {
+	int width;
+	unsigned char *cells;
+	int count;
+	int overlaps;
+} TestBody_callback;
+
+void test_body(void *xy, void *context)
+{
+	TestBody_callback *instance = context;
+	int cell = ((int *)xy)[1] * instance->width + ((int *)xy)[0];
+	instance->overlaps += instance->cells[cell];
+	instance->cells[cell] = 1;
+	instance->count++;
+}
+
+/* Returns 0 if the occupancy agrees with the body walk, prints the first difference otherwise. */
+int test_check(GameContext *game, int width, int height, unsigned char *cells, const char *name, int64_t tick)
+{
+	memset(cells, 0, (size_t)width * height);
+	TestBody_callback body = { width, cells, 0, 0 };
+	game_body_foreach(game, test_body, &body);
+	if (body.overlaps || body.count > game_snake_length(game)) {
+		printf("%s, tick %lld: body of %d segments overlaps itself %d times\n", name, (long long)tick, body.count, body.overlaps);
+		return 1;
+	}
+
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			if (game_is_blocked(game, x, y) != cells[y * width + x]) {
+				printf("%s, tick %lld: cell (%d, %d) is %d in the occupancy and %d in the body\n",
+					name, (long long)tick, x, y, game_is_blocked(game, x, y), cells[y * width + x]);
+				return 1;
+			}
+		}
+	}
+
+	int food[2];
+	game_get_food(game, food);
+	if (food[0] >= 0 && cells[food[1] * width + food[0]]) {
+		printf("%s, tick %lld: food (%d, %d) is on the body\n", name, (long long)tick, food[0], food[1]);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Picks a turn whose next cell is free, towards the food unless 'r' asks for a random one,
+ * so snakes grow long enough for their tails to matter.
+ */
+GameSnakeDirection test_steer(GameContext *game, uint32_t r)
+{
+	const int dx[] = { 0, 0, 0, 1, -1 };
+	const int dy[] = { 0, -1, 1, 0, 0 };
+	int head[2], food[2], move[2];
+	game_get_head(game, head);
+	game_get_food(game, food);
+	game_get_move(game, move);
+
+	GameSnakeDirection best = GSD_NONE;
+	int best_score = -1;
+	for (int d = GSD_DOWN; d <= GSD_LEFT; ++d) {
+		/* A turn along the current axis is refused, the snake keeps going. */
+		int along = (dx[d] && move[0]) || (dy[d] && move[1]);
+		int x = head[0] + (along ? move[0] : dx[d]);
+		int y = head[1] + (along ? move[1] : dy[d]);
+		if (game_is_blocked(game, x, y)) continue;
+		int score = (r & 7) == 0 ? (int)((r >> (3 + 2 * d)) & 3) : 1000 - abs(food[0] - x) - abs(food[1] - y);
+		if (score > best_score) {
+			best_score = score;
+			best = (GameSnakeDirection)d;
+		}
+	}
+	return best;
+}
+
+int test_game(int width, int height, int flags, uint64_t seed, const char *name)
+{
+	GameContext *game = game_create_ex(width, height, seed, flags);
+	unsigned char *cells = malloc((size_t)width * height);
+	void *snapshot = NULL;
+	size_t snapshot_capacity = 0;
+	int has_snapshot = 0;
+	Random random;
+	random_seed(&random, seed);
+
+	game_start(game, width / 2, height / 2);
+	int failed = test_check(game, width, height, cells, name, 0);
+	for (int step = 0; step < TEST_STEPS && !failed; ++step) {
+		uint32_t r = random_next(&random);
+		if ((r & 31) == 0) {
+			game_set_snake_direction(game, (GameSnakeDirection)(1 + ((r >> 5) & 3)));
+		} else {
+			game_set_snake_direction(game, test_steer(game, r >> 5));
+		}
+
+		r = random_next(&random);
+		int lost;
+		if ((r & 15) == 0) {
+			lost = game_advance(game, 1 + ((r >> 4) & 15));
+		} else {
+			lost = game_update(game);
+		}
+		if (lost) {
+			game_start(game, width / 2, height / 2);
+		}
+
+		if (((r >> 12) & 63) == 0) {
+			size_t size = game_snapshot_size(game);
+			if (size > snapshot_capacity) {
+				snapshot_capacity = 2 * size;
+				snapshot = realloc(snapshot, snapshot_capacity);
+			}
+			game_snapshot_save(game, snapshot);
+			has_snapshot = 1;
+		} else if (((r >> 12) & 63) == 1 && has_snapshot) {
+			game_snapshot_restore(game, snapshot);
+		}
+
+		failed = test_check(game, width, height, cells, name, game_ticks(game));
+	}
+
+	free(snapshot);
+	free(cells);
+	game_destroy(game);
+	return failed;
+}
+
+int main(void)
+{
+	const struct {
+		int width, height;
+		int flags;
+		const char *name;
+	} cases[] = {
+		{ 8, 8, 0, "8x8" },
+		{ 15, 15, 0, "15x15" },
+		{ 70, 9, 0, "70x9" },
+		{ 15, 15, GAME_COMPACT_BODY, "15x15 compact" },
+		{ 70, 9, GAME_COMPACT_BODY, "70x9 compact" },
+		{ 130, 70, GAME_CHUNKED, "130x70 chunked" },
+		{ 130, 70, GAME_CHUNKED | GAME_COMPACT_BODY, "130x70 chunked compact" },
+	};
+
+	int failures = 0;
+	for (unsigned i = 0; i < sizeof(cases) / sizeof(*cases); ++i) {
+		for (uint64_t seed = 1; seed <= 3; ++seed) {
+			failures += test_game(cases[i].width, cases[i].height, cases[i].flags, seed, cases[i].name);
+		}
+	}
+
+	printf("occupancy: %s\n", failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GAME_INTERNAL
+#include "game.h"
+#include "random.h"
+
+/*
+ * Snapshot round trips. A game is saved and restored into another game of the same size that
+ * played a different episode, then both are given the same turns and must stay identical tick
+ * for tick: body, head, food, counters, the free set with its holes, and the hash.
+ */
+
+#define TEST_ROUNDS 200 /* Snapshots per case */
+#define TEST_TICKS 100  /* Ticks compared after every restore */
+
+typedef struct {
+	int *cells;          /* (x, y) of every segment, tail first */
+	int count;
+} TestBody_callback;
+
+void test_body(void *xy, void *context)
+{
+	TestBody_callback *instance = context;
+	instance->cells[2 * instance->count] = ((int *)xy)[0];
+	instance->cells[2 * instance->count + 1] = ((int *)xy)[1];
+	instance->count++;
+}
+
+/* Mostly keeps the snake alive, sometimes turns at random so games are lost and restarted. */
+GameSnakeDirection test_turn(GameContext *game, Random *random)
+{
+	const int dx[] = { 0, 0, 0, 1, -1 };
+	const int dy[] = { 0, -1, 1, 0, 0 };
+	int head[2], move[2];
+	game_get_head(game, head);
+	game_get_move(game, move);
+	if (random_bounded(random, 64) == 0) {
+		return (GameSnakeDirection)(1 + random_bounded(random, 4));
+	}
+	int ahead = (move[0] || move[1]) && !game_is_blocked(game, head[0] + move[0], head[1] + move[1]);
+	if (ahead && random_bounded(random, 4)) {
+		return GSD_NONE;
+	}
+
+	int first = random_bounded(random, 4);
+	for (int i = 0; i < 4; ++i) {
+		int d = 1 + (first + i) % 4;
+		int along = (dx[d] && move[0]) || (dy[d] && move[1]);
+		if (!along && !game_is_blocked(game, head[0] + dx[d], head[1] + dy[d])) {
+			return (GameSnakeDirection)d;
+		}
+	}
+	return GSD_NONE;
+}
+
+void test_play(GameContext *game, Random *random, int ticks)
+{
+	for (int i = 0; i < ticks; ++i) {
+		game_set_snake_direction(game, test_turn(game, random));
+		if (game_update(game)) {
+			game_start(game, game->width / 2, game->height / 2);
+		}
+	}
+}
+
+/* Returns 0 if both games are in the same state, prints the first difference otherwise. */
+int test_compare(GameContext *a, GameContext *b, int *cells, const char *name, int round, int tick)
+{
+	const char *what = NULL;
+	TestBody_callback body_a = { cells, 0 };
+	TestBody_callback body_b = { cells + 2 * a->width * a->height, 0 };
+	game_body_foreach(a, test_body, &body_a);
+	game_body_foreach(b, test_body, &body_b);
+
+	if (body_a.count != body_b.count || memcmp(body_a.cells, body_b.cells, 2 * body_a.count * sizeof(int))) {
+		what = "body";
+	} else if (a->snake_x != b->snake_x || a->snake_y != b->snake_y || a->move_x != b->move_x || a->move_y != b->move_y) {
+		what = "head or move";
+	} else if (a->food_x != b->food_x || a->food_y != b->food_y) {
+		what = "food";
+	} else if (a->snake_length != b->snake_length || a->pushes != b->pushes || a->ticks != b->ticks || a->start_tick != b->start_tick) {
+		what = "counters";
+	} else if (a->free_count != b->free_count || memcmp(a->free_cells, b->free_cells, a->free_total * sizeof(int))) {
+		what = "free set";
+	} else if (a->hash != b->hash || game_hash(a) != game_hash(b)) {
+		what = "hash";
+	}
+	for (int key = 0; !what && key < a->free_count; ++key) {
+		int held = a->free_cells[key];
+		if (held != key && a->free_index[held] != b->free_index[held]) {
+			what = "free set holes";
+		}
+	}
+
+	if (what) {
+		printf("%s, round %d, tick %d: the restored game has another %s\n", name, round, tick, what);
+		return 1;
+	}
+	return 0;
+}
+
+int test_snapshot(int width, int height, int flags, const char *name)
+{
+	GameContext *original = game_create_ex(width, height, 7, flags);
+	GameContext *restored = game_create_ex(width, height, 8, flags);
+	int *cells = malloc(4 * (size_t)width * height * sizeof(*cells));
+	void *snapshot = NULL;
+	size_t snapshot_capacity = 0;
+	Random random, other;
+	random_seed(&random, 1);
+	random_seed(&other, 2);
+	game_start(original, width / 2, height / 2);
+	game_start(restored, width / 2, height / 2);
+
+	int failed = 0;
+	for (int round = 0; round < TEST_ROUNDS && !failed; ++round) {
+		test_play(original, &random, random_bounded(&random, 200));
+		test_play(restored, &other, random_bounded(&other, 200));
+
+		size_t size = game_snapshot_size(original);
+		if (size > snapshot_capacity) {
+			snapshot_capacity = 2 * size;
+			snapshot = realloc(snapshot, snapshot_capacity);
+		}
+		game_snapshot_save(original, snapshot);
+		game_snapshot_restore(restored, snapshot);
+
+		failed = test_compare(original, restored, cells, name, round, 0);
+		for (int tick = 1; tick <= TEST_TICKS && !failed; ++tick) {
+			GameSnakeDirection turn = test_turn(original, &random);
+			GameContext *games[] = { original, restored };
+			for (int i = 0; i < 2; ++i) {
+				game_set_snake_direction(games[i], turn);
+				if (game_update(games[i])) {
+					game_start(games[i], width / 2, height / 2);
+				}
+			}
+			failed = test_compare(original, restored, cells, name, round, tick);
+		}
+	}
+
+	free(snapshot);
+	free(cells);
+	game_destroy(original);
+	game_destroy(restored);
+	return failed;
+}
+
+int main(void)
+{
+	const struct {
+		int width, height;
+		int flags;
+		const char *name;
+	} cases[] = {
+		{ 15, 11, 0, "15x11" },
+		{ 15, 11, GAME_COMPACT_BODY, "15x11 compact" },
+		{ 8, 8, 0, "8x8" },
+		{ 70, 9, GAME_COMPACT_BODY, "70x9 compact" },
+	};
+
+	int failures = 0;
+	for (unsigned i = 0; i < sizeof(cases) / sizeof(*cases); ++i) {
+		failures += test_snapshot(cases[i].width, cases[i].height, cases[i].flags, cases[i].name);
+	}
+
+	printf("snapshot: %s\n", failures ? "FAILED" : "ok");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,119 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "replay.h"
+#include "scheduler.h"
+
+#define VERIFY_MAX_TICKS (1LL << 32) /* Longer replays are rejected instead of simulated */
+
+/*
+ * Re-simulates every replay in a directory on all cores and prints, one line per file,
+ * whether it is valid, the final and best score and the number of ticks.
+ *
+ * Usage: verify DIR [WORKERS]
+ */
+
+typedef struct VerifyJob {
+	char *path;
+	ReplayResult result;
+} VerifyJob;
+
+double verify_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void verify_task(void *arg, int worker)
+{
+	(void)worker;
+	VerifyJob *job = arg;
+	memset(&job->result, 0, sizeof(job->result));
+
+	int fd = open(job->path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+		job->result.error = "can't read";
+		if (fd >= 0) close(fd);
+		return;
+	}
+	if (st.st_size == 0) {
+		job->result.error = "bad header";
+		close(fd);
+		return;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		job->result.error = "can't map";
+		return;
+	}
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+	replay_run(data, st.st_size, VERIFY_MAX_TICKS, &job->result);
+	munmap(data, st.st_size);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2 || argc > 3) {
+		fprintf(stderr, "Usage: %s DIR [WORKERS]\n", argv[0]);
+		return -1;
+	}
+
+	DIR *dir = opendir(argv[1]);
+	if (!dir) {
+		fprintf(stderr, "Failed to open '%s'.\n", argv[1]);
+		return -1;
+	}
+
+	int count = 0, capacity = 1024;
+	VerifyJob *jobs = malloc(capacity * sizeof(*jobs));
+	struct dirent *entry;
+	while ((entry = readdir(dir))) {
+		if (entry->d_name[0] == '.' || (entry->d_type != DT_REG && entry->d_type != DT_UNKNOWN)) {
+			continue;
+		}
+		if (count == capacity) {
+			capacity *= 2;
+			jobs = realloc(jobs, capacity * sizeof(*jobs));
+		}
+		jobs[count].path = malloc(strlen(argv[1]) + strlen(entry->d_name) + 2);
+		sprintf(jobs[count].path, "%s/%s", argv[1], entry->d_name);
+		count++;
+	}
+	closedir(dir);
+
+	Scheduler *s = scheduler_create(argc == 3 ? atoi(argv[2]) : 0);
+	double start = verify_now();
+	for (int i = 0; i < count; ++i) {
+		scheduler_submit(s, verify_task, &jobs[i]);
+	}
+	scheduler_wait(s);
+	double elapsed = verify_now() - start;
+
+	int valid = 0;
+	int64_t ticks = 0;
+	for (int i = 0; i < count; ++i) {
+		ReplayResult *r = &jobs[i].result;
+		printf("%s\t%s\tscore %d\tbest %d\tticks %lld\tgames %d\n", jobs[i].path, r->valid ? "valid" : r->error,
+			r->score, r->best, (long long)r->ticks, r->episodes);
+		valid += r->valid;
+		ticks += r->ticks;
+		free(jobs[i].path);
+	}
+	fprintf(stderr, "%d replays, %d valid, %d workers, %.3f s, %.0f replays/s, %.3g ticks/s\n",
+		count, valid, scheduler_workers(s), elapsed, count / elapsed, ticks / elapsed);
+
+	scheduler_destroy(s);
+	free(jobs);
+	return valid == count ? 0 : 1;
+}